@@ -0,0 +1,43 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator: memory is only released all at once by arena_free.
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;
+    size_t used;
+    _Alignas(16) char data[];
+} ArenaChunk;
+
+typedef struct Arena {
+    ArenaChunk *chunks; // the current chunk first
+    size_t next_size;
+} Arena;
+
+Arena* create_arena();
+void arena_free(Arena *arena);
+
+void* arena_alloc(Arena *arena, size_t size);
+char* arena_strdup(Arena *arena, const char *string);
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdbool.h>
+
+#include "kitty.h"
+#include "transactions.h"
+
+// How a kitty is kept on disk. The snapshot file is data<extension>.
+typedef struct StorageBackend {
+    const char* name;
+    const char* extension;
+
+    Kitty* (*load)(const char* path); // read the snapshot
+    int (*open)(Kitty* kitty); // attach to a loaded kitty, e.g. replay the journal
+    void (*append)(Kitty* kitty, const Transaction* t); // record a new transaction
+    void (*undo)(Kitty* kitty); // record that the last transaction was reverted
+    int (*commit)(Kitty* kitty); // persist everything recorded so far
+    int (*checkpoint)(Kitty* kitty); // rewrite the snapshot
+    void (*discard)(Kitty* kitty); // forget everything recorded since the last commit
+    void (*close)(Kitty* kitty);
+} StorageBackend;
+
+extern const StorageBackend xml_backend;
+extern const StorageBackend journal_backend;
+extern const StorageBackend binary_backend;
+
+const StorageBackend* find_storage_backend(const char* name);
+const char* get_database_file_path(const StorageBackend* backend);
+
+#define KITTY_LOCK_TIMEOUT_MS 10000
+
+// identifies the contents of a file without reading it
+typedef struct FileStamp {
+    long inode;
+    long size;
+    long mtime_sec;
+    long mtime_nsec;
+} FileStamp;
+
+// of the database files, to notice when someone else saved the database
+typedef struct DatabaseStamp {
+    FileStamp xml;
+    FileStamp binary;
+    FileStamp journal;
+} DatabaseStamp;
+
+int lock_database(bool exclusive, long timeout_ms); // of the selected kitty, returns the lock or -1
+void unlock_database(int lock);
+void database_stamp(DatabaseStamp* stamp);
+bool database_changed(const DatabaseStamp* stamp);
+
+bool database_exists();
+int create_database();
+Kitty *load_kitty();
+int save_kitty(Kitty *kitty);
+int checkpoint_kitty(Kitty *kitty);
+void discard_kitty(Kitty *kitty);
+int convert_kitty(Kitty *kitty, const StorageBackend* backend);
+void close_kitty(Kitty *kitty);
+void unload_kitty(Kitty *kitty); // close and free
+
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+#ifndef BINARY_H
+#define BINARY_H
+
+#include "kitty.h"
+#include "cache.h"
+
+#define KITTY_BINARY_MAGIC "CKITTY\r\n"
+#define KITTY_BINARY_VERSION 3
+
+int read_binary_source(const char *path, CacheKey *source);
+Kitty *load_kitty_from_binary(const char *path);
+int save_kitty_to_binary(const char *path, const Kitty *kitty, const CacheKey *source);
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#include "kitty.h"
+
+// identifies the contents of data.xml a cache was created from
+typedef struct CacheKey {
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t hash;
+} CacheKey;
+
+int cache_key_of_file(const char *path, CacheKey *key);
+Kitty *load_kitty_from_cache(const char *cache_path, const char *xml_path);
+int save_kitty_to_cache(const char *cache_path, const char *xml_path, const Kitty *kitty);
+
+#endif
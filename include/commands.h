@@ -20,13 +20,25 @@
 
 #include "kitty.h"
 
+// how a command accesses the database, in increasing order
+enum command_access {
+    COMMAND_NO_KITTY = 0, // kitty is NULL
+    COMMAND_READS = 1,
+    COMMAND_APPENDS = 2, // writes nothing but new transactions
+    COMMAND_WRITES = 3,
+};
+
 typedef struct Command {
     char* name;
     int (*function)(int argc, char** argv, Kitty* kitty);
     char* help;
+    enum command_access access;
 } Command;
 
 void print_commands(char* argv0);
+const Command* find_command(int argc, char** argv);
+bool command_asks(int argc, char** argv);
+bool confirm_command(int argc, char** argv);
 
 // General
 int command_print(int argc, char** argv, Kitty* kitty);
@@ -34,6 +46,9 @@ int command_help(int argc, char** argv, Kitty* kitty);
 int command_about(int argc, char** argv, Kitty* kitty);
 // Kitty management
 int command_set(int argc, char** argv, Kitty* kitty);
+int command_checkpoint(int argc, char** argv, Kitty* kitty);
+int command_convert(int argc, char** argv, Kitty* kitty);
+int command_batch(int argc, char** argv, Kitty* kitty);
 // Transaction management
 int command_drink(int argc, char** argv, Kitty* kitty);
 int command_buy(int argc, char** argv, Kitty* kitty);
@@ -44,6 +59,7 @@ int command_undo(int argc, char** argv, Kitty* kitty);
 // Output management
 int command_latex(int argc, char** argv, Kitty* kitty);
 int command_thirst(int argc, char** argv, Kitty* kitty);
+int command_history(int argc, char** argv, Kitty* kitty);
 // Person management
 int command_add(int argc, char** argv, Kitty* kitty);
 int command_remove(int argc, char** argv, Kitty* kitty);
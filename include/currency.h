@@ -27,28 +27,26 @@ typedef struct Currency{
     char decimal;
 } Currency;
 
+// amount of money, the currency is implied by the kitty it belongs to
 typedef struct CurrencyValue{
     int value; // in cents or whatever is the subunit
-    Currency *currency;
 } CurrencyValue;
 
 Currency *currency_alloc(char* isoname, bool prefix, int subunit_digits, char decimal);
 Currency *create_currency_from_locale();
-CurrencyValue *currency_value_alloc(int value, Currency *currency);
 void currency_free(Currency *c);
-void currency_value_free(CurrencyValue *cv);
-CurrencyValue* currency_value_copy(CurrencyValue *cv);
-
-const char* currency_value_format_color_prefix(CurrencyValue *cv);
-const char* currency_value_format_color_suffix(CurrencyValue *cv);
-const char* currency_value_format(CurrencyValue* cv, bool color, bool affix);
-CurrencyValue* ftocv(float value, Currency *currency);
-
-void currency_value_add(CurrencyValue *cv1, CurrencyValue *cv2);
-void currency_value_sub(CurrencyValue *cv1, CurrencyValue *cv2);
-void currency_value_mul(CurrencyValue *cv, int factor);
-void currency_value_div(CurrencyValue *cv, int divisor);
-void currency_value_negative(CurrencyValue *cv);
-CurrencyValue* currency_value_new_negative(CurrencyValue *cv);
+
+CurrencyValue currency_value(int value);
+
+const char* currency_value_format_color_prefix(CurrencyValue cv);
+const char* currency_value_format_color_suffix(CurrencyValue cv);
+const char* currency_value_format(CurrencyValue cv, const Currency *currency, bool color, bool affix);
+CurrencyValue ftocv(float value, const Currency *currency);
+
+CurrencyValue currency_value_add(CurrencyValue cv1, CurrencyValue cv2);
+CurrencyValue currency_value_sub(CurrencyValue cv1, CurrencyValue cv2);
+CurrencyValue currency_value_mul(CurrencyValue cv, int factor);
+CurrencyValue currency_value_div(CurrencyValue cv, int divisor);
+CurrencyValue currency_value_negative(CurrencyValue cv);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,15 @@
+/* This file is automatically generated by gitinfo_headgen.sh.
+ * Do not edit this file directly.
+ */
+
+#ifndef GITINFO_H
+#define GITINFO_H
+
+#define GIT_VERSION "master@daeabc4"
+
+#define GIT_HASH "daeabc4"
+#define GIT_BRANCH "master"
+#define GIT_TAG ""
+
+#endif
+
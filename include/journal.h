@@ -0,0 +1,57 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kitty.h"
+#include "transactions.h"
+
+#define KITTY_JOURNAL_MAGIC "coffeekitty-journal"
+#define KITTY_JOURNAL_VERSION 2
+
+// The journal holds the transactions recorded since the last full save of
+// data.xml, one record per line. It is only valid for the snapshot whose
+// generation matches the one in its header.
+typedef struct Journal {
+    char *path;
+    long generation;
+    bool valid; // file exists and belongs to this generation
+    long end; // offset behind the last complete record on disk
+    int records; // records on disk
+
+    // records not yet written to disk
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    int pending;
+} Journal;
+
+Journal* journal_alloc(const char *path, long generation);
+void journal_free(Journal *j);
+
+int journal_replay(Journal *j, Kitty *kitty);
+void journal_record_transaction(Journal *j, const Transaction *t);
+void journal_record_undo(Journal *j, long timestamp);
+int journal_commit(Journal *j, const char *database_path);
+void journal_discard(Journal *j);
+int journal_reset(Journal *j, long generation);
+
+#endif
@@ -18,24 +18,55 @@
 #ifndef KITTY_H
 #define KITTY_H
 
+#include <stdbool.h>
+
 #include "settings.h"
 #include "currency.h"
 #include "person.h"
 #include "transactions.h"
+#include "person_index.h"
+#include "arena.h"
+
+struct Journal;
+struct StorageBackend;
 
 typedef struct Kitty{
-    CurrencyValue *balance;
-    CurrencyValue *price;
+    Arena *arena; // persons, names and deltas live as long as the kitty
+    CurrencyValue balance;
+    CurrencyValue price;
 
     int packs;
     int counter;
 
     Person *persons;
+    PersonTable person_table; // numbers of the persons
+    PersonIndex *person_index; // of persons by name
+    int next_person_id;
     Settings *settings;
-    Transaction *transactions;
+    TransactionLog transactions;
+    TimeIndex time_index; // of transactions
+
+    const struct StorageBackend *storage;
+    long generation; // of the snapshot on disk
+    bool dirty; // changed beyond what the storage backend has recorded
+    struct Journal *journal; // of journaled storage backends
 } Kitty;
 
-Kitty *create_kitty(int balance, int price, int packs, int counter, Settings* settings, Person* persons, Transaction* transactions);
+Kitty *create_kitty(int balance, int price, int packs, int counter, Settings* settings, Person* persons, PersonTable* person_table, TransactionLog* transactions, Arena* arena);
 void kitty_free(Kitty *k);
+void kitty_compact(Kitty *k);
+
+// persons of a kitty, keeping the index up to date
+Person* kitty_find_person(const Kitty *k, const char *name);
+Person* kitty_find_any_person(const Kitty *k, const char *name);
+Person* kitty_add_person(Kitty *k, Person *person);
+void kitty_remove_person(Kitty *k, Person *person);
+void kitty_purge_person(Kitty *k, Person *person);
+Person* kitty_rename_person(Kitty *k, Person *person, char *new_name);
+
+// transactions of a kitty, keeping the transactions of each person up to date
+Transaction* kitty_push_transaction(Kitty *k, const Transaction *t);
+bool kitty_pop_transaction(Kitty *k, Transaction *t);
+void kitty_remove_transactions_with_target(Kitty *k, Person *person);
 
 #endif
\ No newline at end of file
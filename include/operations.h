@@ -24,15 +24,18 @@
 #include "kitty.h"
 #include "transactions.h"
 
-void person_pays_debt(Kitty* kitty, Person* person,  CurrencyValue* payment);
-void person_buys_misc(Kitty* kitty, Person* person, CurrencyValue* cost);
+void person_pays_debt(Kitty* kitty, Person* person,  CurrencyValue payment);
+void person_buys_misc(Kitty* kitty, Person* person, CurrencyValue cost);
 void person_drinks_coffee(Kitty* kitty, Person* person, int amount);
-void buy_coffee(Kitty* kitty, int amount, CurrencyValue* cost);
+void buy_coffee(Kitty* kitty, int amount, CurrencyValue cost);
 void consume_pack(Kitty* kitty);
 
-void calculate_thirst(Person* person);
+void calculate_thirst(PersonTable* table);
 
 void apply_transaction(Kitty *kitty, Transaction *t);
-void revert_transaction(Kitty *kitty, Transaction *t);
+void revert_transaction(Kitty *kitty); // the last one
+void replay_transaction(Kitty *kitty, Transaction *t);
+int replay_undo(Kitty *kitty);
+int rebase_transactions(Kitty *kitty, const Kitty *stale, size_t first);
 
 #endif
\ No newline at end of file
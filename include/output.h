@@ -24,11 +24,11 @@
 #include "person.h"
 #include "transactions.h"
 
-void fprint_person(FILE* file, Person *p);
-void print_persons(Person *head);
+void fprint_person(FILE* file, const Kitty *kitty, const Person *p);
+void print_persons(const Kitty *kitty);
 void fprint_kitty(FILE* file, Kitty *k);
 void print_help(char* argv0);
-void fprint_transaction(FILE* file, Transaction* transaction);
+void fprint_transaction(FILE* file, Transaction* transaction, Currency* currency);
 
 void fprint_hline(FILE* file, int width);
 void fprint_output(FILE* file, Kitty* kitty);
@@ -18,29 +18,61 @@
 #ifndef PERSON_H
 #define PERSON_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "currency.h"
+#include "arena.h"
+
+// ids are handed out by the kitty and never change, transactions are stored
+// with the id of their target
+#define PERSON_NO_ID -1
+#define PERSON_MAX_ID (1 << 24)
+
+// The numbers of the persons are kept in a table with one column per field,
+// so that going over all persons is a loop over plain arrays. Rows are not
+// reused, a row without a person in the kitty is marked as removed.
+typedef struct PersonTable {
+    CurrencyValue *balance;
+    float *thirst;
+    int *current_coffees;
+    int *total_coffees;
+    unsigned char *removed; // kept for the transactions referring to it, but hidden
+    int rows;
+    int capacity;
+} PersonTable;
 
 typedef struct Person{
+    int id;
+    int row; // in the person table
     char *name;
     int name_length;
 
-    float thirst;
-    int current_coffees;
-    int total_coffees;
-    CurrencyValue* balance;
+    // indices of the transactions in the log of the kitty with this person
+    // as a target, ascending
+    size_t *transactions;
+    size_t transaction_count;
+    size_t transaction_capacity;
 
     struct Person* next;
 } Person;
 
-Person* person_create_full(char* name, int balance, Currency* currency, float thirst, int current_coffees, int total_coffees);
-Person* create_person(char* name, int balance, Currency* currency);
-void person_free(Person *p);
-void persons_free(Person *persons);
+void person_table_init(PersonTable *table);
+void person_table_free(PersonTable *table);
+int person_table_add_row(PersonTable *table, int balance, float thirst, int current_coffees, int total_coffees);
+CurrencyValue person_table_debts(const PersonTable *table);
+CurrencyValue person_table_credits(const PersonTable *table);
+
+Person* person_create_full(Arena* arena, PersonTable* table, char* name, int balance, float thirst, int current_coffees, int total_coffees);
+Person* create_person(Arena* arena, PersonTable* table, char* name, int balance);
 Person* person_add(Person **head, Person *person);
 void person_remove(Person **head, Person *person_to_remove);
-Person* person_rename(Person *persons, Person *person, char *new_name);
-Person *get_person_by_name(Person *persons, char *name);
+Person* person_rename(Arena* arena, Person *person, char *new_name);
 void sort_persons_by_name(Person **head);
 int get_person_count(Person *persons);
+Person** person_id_table(Person *persons, int *size);
+void person_add_transaction(Person *person, size_t index);
+void person_remove_transaction(Person *person, size_t index);
+void person_free_transactions(Person *person);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,40 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+
+#ifndef PERSON_INDEX_H
+#define PERSON_INDEX_H
+
+#include <stddef.h>
+
+#include "person.h"
+
+// name -> Person* hash table with open addressing; it does not own the persons
+typedef struct PersonIndex {
+    Person **slots;
+    size_t capacity; // power of two
+    size_t count;
+} PersonIndex;
+
+PersonIndex* person_index_alloc(size_t expected);
+void person_index_free(PersonIndex *index);
+
+Person* person_index_find(const PersonIndex *index, const char *name);
+void person_index_insert(PersonIndex *index, Person *person); // name must not be indexed yet
+void person_index_remove(PersonIndex *index, const Person *person);
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+
+/*
+ * coffeekitty and coffeekittyd talk over the Unix socket
+ * $HOME/.coffeekitty/coffeekittyd.sock:
+ *
+ *   request:  version, argc, then the working directory, the name of the
+ *             kitty (empty for the default one) and argv[0..argc), all
+ *             integers as uint32 and strings as uint32 length + bytes
+ *   stdin:    whatever the client reads from its stdin, until it shuts down
+ *             its side of the connection
+ *   response: the output of the command, a NUL byte and the exit status
+ *             as a single byte
+ */
+
+#define KITTY_PROTOCOL_VERSION 2
+#define KITTY_PROTOCOL_MAX_ARGS 4096
+#define KITTY_PROTOCOL_MAX_STRING 65536
+
+int send_all(int fd, const void* buffer, size_t length);
+int recv_all(int fd, void* buffer, size_t length);
+
+int connect_daemon(); // -1 if no daemon is running
+int forward_command(int fd, int argc, char** argv); // on a connection to the daemon, returns the status
+
+int send_request(int fd, const char* cwd, const char* kitty, int argc, char** argv);
+char** recv_request(int fd, int* argc, char** cwd, char** kitty); // NULL on failure
+void free_request(int argc, char** argv, char* cwd, char* kitty);
+
+#endif
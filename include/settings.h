@@ -18,12 +18,18 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+#include <stdbool.h>
+
 #include "currency.h"
 
 #define MAX_SETTINGS_ENTRY_KEY_LENGTH 128
+#define DEFAULT_CHECKPOINT_INTERVAL 100
 
 typedef struct Settings{
     Currency *currency;
+    bool journal; // append transactions to data.journal instead of rewriting data.xml
+    int checkpoint_interval; // journal records before the database is rewritten
+    bool indent; // pretty-print data.xml
 } Settings;
 
 typedef struct SettingsEntry{
@@ -18,14 +18,32 @@
 #ifndef STORAGE_H
 #define STORAGE_H
 
+#include <stdio.h>
+
 #include "kitty.h"
 
-#define KITTY_STORAGE_VERSION "1.0"
+#define KITTY_STORAGE_VERSION "2.1"
+#define KITTY_STORAGE_VERSION_FIRST "1.0" // still loaded
+#define KITTY_NAME_MAX 64
 
 Kitty *load_kitty_from_xml(const char *path);
 const char* get_config_directory();
+int select_kitty(const char* name);
+const char* get_kitty_name();
+const char* get_kitty_directory(); // of the selected kitty
 const char* get_config_file_path(); 
+const char* get_cache_file_path();
+const char* get_journal_file_path();
+const char* get_lock_file_path();
+const char* get_socket_file_path();
 int mkdir_p(const char *path);
 int save_kitty_to_xml(const char *path, const Kitty *kitty);
 
+int copy_permissions(FILE *file, const char *path);
+int sync_directory(const char *path); // containing path
+FILE* atomic_open(const char *path, char *temp_path, size_t size);
+int atomic_commit(FILE *file, const char *temp_path, const char *path);
+void atomic_abort(FILE *file, const char *temp_path);
+
+
 #endif
\ No newline at end of file
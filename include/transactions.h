@@ -18,8 +18,12 @@
 #ifndef TRANSACTIONS_H
 #define TRANSACTIONS_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "person.h"
 #include "currency.h"
+#include "arena.h"
 
 enum transaction_type {
     PERSON_PAYS_DEBT = 0,
@@ -30,54 +34,64 @@ enum transaction_type {
     UNDO = 5,
 };
 
-typedef struct BalanceDelta {
-    CurrencyValue* cv;
-    Person* target;
-    struct BalanceDelta* next;
-} BalanceDelta;
+enum delta_kind {
+    BALANCE_DELTA = 0,
+    PACKS_DELTA = 1,
+    COUNTER_DELTA = 2,
+};
 
-typedef struct PacksDelta {
-    int packs;
-    struct PacksDelta* next;
-} PacksDelta;
+typedef struct Delta {
+    enum delta_kind kind;
+    int value; // subunits of the currency for balance deltas
+    Person* target; // NULL ⇒ kitty, always NULL for packs deltas
+} Delta;
 
-typedef struct CounterDelta {
-    int counter;
-    Person* target;
-    struct CounterDelta* next;
-} CounterDelta;
+// enough for every transaction the commands create
+#define TRANSACTION_INLINE_DELTAS 3
 
 typedef struct Transaction {
     enum transaction_type type;
     long timestamp;
-    BalanceDelta* balance_delta_head;
-    PacksDelta* packs_delta_head;
-    CounterDelta* counter_delta_head;
-    struct Transaction* next;
+    int delta_count;
+    int delta_capacity; // above TRANSACTION_INLINE_DELTAS, the deltas are in overflow (in the arena of the kitty)
+    union {
+        Delta inline_deltas[TRANSACTION_INLINE_DELTAS];
+        Delta* overflow;
+    };
 } Transaction;
 
-BalanceDelta* balance_delta_alloc(CurrencyValue* cv, Person* target);
-BalanceDelta* balance_delta_add(BalanceDelta** head, BalanceDelta* delta);
-void balance_delta_free(BalanceDelta* delta);
-void balance_deltas_free(BalanceDelta* head);
+// transactions in chronological order, stored by value
+typedef struct TransactionLog {
+    Transaction* items;
+    size_t length;
+    size_t capacity;
+} TransactionLog;
 
-PacksDelta* packs_delta_alloc(int packs);
-PacksDelta* packs_delta_add(PacksDelta** head, PacksDelta* delta);
-void packs_delta_free(PacksDelta* delta);
-void packs_deltas_free(PacksDelta* head);
+// indices into a transaction log, ordered by timestamp and then by index
+typedef struct TimeIndex {
+    size_t* items;
+    size_t length;
+    size_t capacity;
+} TimeIndex;
 
-CounterDelta* counter_delta_alloc(int counter, Person* target);
-CounterDelta* counter_delta_add(CounterDelta** head, CounterDelta* delta);
-void counter_delta_free(CounterDelta* delta);
-void counter_deltas_free(CounterDelta* head);
+void transaction_init(Transaction* t, enum transaction_type type, long timestamp);
+Delta* transaction_deltas(const Transaction* t);
+void transaction_add_delta(Transaction* t, Arena* arena, enum delta_kind kind, int value, Person* target);
+bool transaction_has_deltas(const Transaction* t, enum delta_kind kind);
+void transaction_invert(const Transaction* transaction, Transaction* inverted, Arena* arena);
 
-Transaction* transaction_alloc(enum transaction_type type, long timestamp);
-Transaction* transaction_add(Transaction** head, Transaction* t);
-Transaction* transaction_pop(Transaction** head);
-void transaction_free(Transaction* t);
-void transactions_free(Transaction* head);
+void transaction_log_init(TransactionLog* log);
+void transaction_log_free(TransactionLog* log);
+void transaction_log_reserve(TransactionLog* log, size_t capacity);
+Transaction* transaction_log_push(TransactionLog* log, const Transaction* t);
+Transaction* transaction_log_last(const TransactionLog* log);
+bool transaction_log_pop(TransactionLog* log, Transaction* t);
 
-Transaction* transaction_invert(Transaction* transaction);
-Transaction* clear_transactions_with_target(Transaction** head, Person* target);
+void time_index_init(TimeIndex* index);
+void time_index_free(TimeIndex* index);
+void time_index_build(TimeIndex* index, const TransactionLog* log);
+void time_index_insert(TimeIndex* index, const TransactionLog* log, size_t position);
+void time_index_remove(TimeIndex* index, const TransactionLog* log, size_t position);
+size_t time_index_lower_bound(const TimeIndex* index, const TransactionLog* log, long timestamp);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_MIN_CHUNK_SIZE (64 * 1024)
+#define ARENA_MAX_CHUNK_SIZE (16 * 1024 * 1024)
+
+Arena* create_arena()
+{
+    Arena *arena = malloc(sizeof(Arena));
+    arena->chunks = NULL;
+    arena->next_size = ARENA_MIN_CHUNK_SIZE;
+    return arena;
+}
+
+void arena_free(Arena *arena)
+{
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+static ArenaChunk* arena_add_chunk(Arena *arena, size_t size)
+{
+    // chunks grow with the arena, so large kitties need few of them
+    size_t chunk_size = arena->next_size;
+    if (arena->next_size < ARENA_MAX_CHUNK_SIZE) {
+        arena->next_size *= 2;
+    }
+    if (chunk_size < size) {
+        chunk_size = size;
+    }
+
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + chunk_size);
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    return chunk;
+}
+
+void* arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+
+    ArenaChunk *chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        chunk = arena_add_chunk(arena, size);
+    }
+
+    void *memory = chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+char* arena_strdup(Arena *arena, const char *string)
+{
+    size_t size = strlen(string) + 1;
+    char *copy = arena_alloc(arena, size);
+    memcpy(copy, string, size);
+    return copy;
+}
@@ -0,0 +1,457 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+#include "backend.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+    #include <linux/limits.h>
+#elif defined(__APPLE__)
+    #include <sys/syslimits.h>
+#endif
+
+#include "kitty.h"
+#include "person.h"
+#include "transactions.h"
+#include "storage.h"
+#include "journal.h"
+#include "cache.h"
+#include "binary.h"
+
+static const StorageBackend* storage_backends[] = {
+    &journal_backend, // default for new databases
+    &xml_backend,
+    &binary_backend,
+    NULL
+};
+
+const StorageBackend* find_storage_backend(const char* name)
+{
+    for (int i = 0; storage_backends[i]; i++) {
+        if (strcmp(storage_backends[i]->name, name) == 0) {
+            return storage_backends[i];
+        }
+    }
+    return NULL;
+}
+
+const char* get_database_file_path(const StorageBackend* backend)
+{
+    _Thread_local static char rval[PATH_MAX];
+    snprintf(rval, PATH_MAX, "%s/data%s", get_kitty_directory(), backend->extension);
+    return rval;
+}
+
+/* xml: data.xml is rewritten whenever something changed */
+
+static Kitty* xml_load(const char* path)
+{
+    // data.xml is the source of truth, data.bin only a faster copy of it
+    Kitty *kitty = load_kitty_from_cache(get_cache_file_path(), path);
+    if (!kitty) {
+        kitty = load_kitty_from_xml(path);
+        if (!kitty) {
+            return NULL;
+        }
+        save_kitty_to_cache(get_cache_file_path(), path, kitty);
+    }
+    return kitty;
+}
+
+static int xml_open(Kitty* kitty)
+{
+    (void)kitty;
+    return 0;
+}
+
+static void xml_append(Kitty* kitty, const Transaction* t)
+{
+    (void)t;
+    kitty->dirty = true;
+}
+
+static void xml_undo(Kitty* kitty)
+{
+    kitty->dirty = true;
+}
+
+static int xml_commit(Kitty* kitty)
+{
+    return kitty->dirty ? kitty->storage->checkpoint(kitty) : 0;
+}
+
+static int xml_checkpoint(Kitty* kitty)
+{
+    const char* path = get_database_file_path(&xml_backend);
+
+    // the kitty is written completely anyway, memory it no longer uses goes with it
+    kitty_compact(kitty);
+    sort_persons_by_name(&kitty->persons);
+
+    kitty->generation++;
+    if (save_kitty_to_xml(path, kitty)) {
+        kitty->generation--;
+        return 1;
+    }
+    kitty->dirty = false;
+    save_kitty_to_cache(get_cache_file_path(), path, kitty);
+    return 0;
+}
+
+static void xml_discard(Kitty* kitty)
+{
+    kitty->dirty = false;
+}
+
+static void xml_close(Kitty* kitty)
+{
+    (void)kitty;
+}
+
+const StorageBackend xml_backend = {
+    "xml", ".xml",
+    xml_load, xml_open, xml_append, xml_undo, xml_commit, xml_checkpoint, xml_discard, xml_close
+};
+
+/* journaled: transactions are appended to data.journal, the snapshot is only
+ * rewritten for other changes and every checkpoint_interval transactions */
+
+static int journaled_open(Kitty* kitty)
+{
+    if (kitty->journal) { // created by a checkpoint
+        return 0;
+    }
+
+    kitty->journal = journal_alloc(get_journal_file_path(), kitty->generation);
+    if (journal_replay(kitty->journal, kitty)) {
+        fprintf(stderr, "Failed to read journal %s\n", kitty->journal->path);
+        return 1;
+    }
+    return 0;
+}
+
+static void journaled_append(Kitty* kitty, const Transaction* t)
+{
+    journal_record_transaction(kitty->journal, t);
+}
+
+static void journaled_undo(Kitty* kitty)
+{
+    journal_record_undo(kitty->journal, time(NULL));
+}
+
+static int journaled_commit(Kitty* kitty)
+{
+    // everything but transactions requires a new snapshot
+    if (kitty->dirty) {
+        return kitty->storage->checkpoint(kitty);
+    }
+
+    if (!kitty->journal) {
+        fprintf(stderr, "Failed to save database, the journal is not open\n");
+        return 1;
+    }
+    if (kitty->journal->pending == 0) {
+        return 0;
+    }
+
+    if (journal_commit(kitty->journal, get_database_file_path(kitty->storage))) {
+        fprintf(stderr, "Falling back to rewriting the database\n");
+        return kitty->storage->checkpoint(kitty);
+    }
+
+    // keep the replay on startup short
+    int interval = kitty->settings->checkpoint_interval;
+    if (interval > 0 && kitty->journal->records >= interval) {
+        return kitty->storage->checkpoint(kitty);
+    }
+
+    return 0;
+}
+
+// everything in the journal is part of the new snapshot
+static int journaled_reset(Kitty* kitty)
+{
+    if (!kitty->journal) {
+        kitty->journal = journal_alloc(get_journal_file_path(), kitty->generation);
+    }
+    return journal_reset(kitty->journal, kitty->generation);
+}
+
+static int journaled_checkpoint(Kitty* kitty)
+{
+    if (xml_checkpoint(kitty)) {
+        return 1;
+    }
+    return journaled_reset(kitty);
+}
+
+static void journaled_discard(Kitty* kitty)
+{
+    journal_discard(kitty->journal);
+    kitty->dirty = false;
+}
+
+static void journaled_close(Kitty* kitty)
+{
+    if (kitty->journal) {
+        journal_free(kitty->journal);
+        kitty->journal = NULL;
+    }
+}
+
+const StorageBackend journal_backend = {
+    "journal", ".xml",
+    xml_load, journaled_open, journaled_append, journaled_undo, journaled_commit, journaled_checkpoint, journaled_discard, journaled_close
+};
+
+/* binary: data.ckb as snapshot, transactions are journaled */
+
+static int binary_checkpoint(Kitty* kitty)
+{
+    kitty_compact(kitty);
+    sort_persons_by_name(&kitty->persons);
+
+    kitty->generation++;
+    if (save_kitty_to_binary(get_database_file_path(&binary_backend), kitty, NULL)) {
+        kitty->generation--;
+        return 1;
+    }
+    kitty->dirty = false;
+
+    return journaled_reset(kitty);
+}
+
+const StorageBackend binary_backend = {
+    "binary", ".ckb",
+    load_kitty_from_binary, journaled_open, journaled_append, journaled_undo, journaled_commit, binary_checkpoint, journaled_discard, journaled_close
+};
+
+/* locking: data.lock of a kitty is locked while it is loaded, shared for
+ * reading and exclusive for writing. The database files can not be locked
+ * themselves, they are replaced whenever they are rewritten. */
+
+// returns the file descriptor holding the lock, -1 on failure or when it is
+// still held by someone else after timeout_ms
+int lock_database(bool exclusive, long timeout_ms)
+{
+    const char* path = get_lock_file_path();
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0 && errno == ENOENT && mkdir_p(get_kitty_directory()) == 0) {
+        fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return -1;
+    }
+
+    // wait for the others, but not forever
+    long waited = 0;
+    long delay = 1;
+    while (flock(fd, (exclusive ? LOCK_EX : LOCK_SH) | LOCK_NB)) {
+        if (errno != EWOULDBLOCK && errno != EINTR) {
+            fprintf(stderr, "Failed to lock %s\n", path);
+            close(fd);
+            return -1;
+        }
+        if (waited >= timeout_ms) {
+            if (waited)
+                fprintf(stderr, "Failed to lock %s, the database has been busy for %li seconds\n", path, waited / 1000);
+            else
+                fprintf(stderr, "Failed to lock %s, the database is busy\n", path);
+            close(fd);
+            return -1;
+        }
+
+        struct timespec ts = {0, delay * 1000000};
+        nanosleep(&ts, NULL);
+        waited += delay;
+        delay = delay < 64 ? delay * 2 : 64;
+    }
+    return fd;
+}
+
+void unlock_database(int fd)
+{
+    close(fd);
+}
+
+static void stamp_file(const char* path, FileStamp* stamp)
+{
+    struct stat st;
+    memset(stamp, 0, sizeof(FileStamp));
+    if (stat(path, &st)) {
+        return;
+    }
+
+    stamp->inode = st.st_ino;
+    stamp->size = st.st_size;
+    stamp->mtime_sec = st.st_mtime;
+#if defined(__APPLE__)
+    stamp->mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    stamp->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+}
+
+void database_stamp(DatabaseStamp* stamp)
+{
+    stamp_file(get_database_file_path(&xml_backend), &stamp->xml);
+    stamp_file(get_database_file_path(&binary_backend), &stamp->binary);
+    stamp_file(get_journal_file_path(), &stamp->journal);
+}
+
+bool database_changed(const DatabaseStamp* stamp)
+{
+    DatabaseStamp current;
+    database_stamp(&current);
+    return memcmp(&current, stamp, sizeof(DatabaseStamp)) != 0;
+}
+
+/* kitty */
+
+bool database_exists()
+{
+    return access(get_database_file_path(&binary_backend), F_OK) == 0
+        || access(get_database_file_path(&xml_backend), F_OK) == 0;
+}
+
+int create_database()
+{
+    fprintf(stderr, "Creating database...\n");
+
+    Settings *settings = settings_alloc(currency_alloc("EUR", false, 2, '.'));
+    Person *persons = NULL;
+    Kitty *kitty = create_kitty(0, 25, 0, 0, settings, persons, NULL, NULL, NULL);
+
+    int rval = 0;
+    if (mkdir_p(get_kitty_directory())) {
+        fprintf(stderr, "Failed to create directory\n");
+        rval = 1;
+    } else if (save_kitty_to_xml(get_database_file_path(&xml_backend), kitty)) {
+        fprintf(stderr, "Failed to save database\n");
+        rval = 1;
+    }
+
+    unload_kitty(kitty);
+    return rval;
+}
+
+Kitty *load_kitty()
+{
+    // the file extension tells the format, xml databases know whether they are journaled
+    const StorageBackend* backend = &binary_backend;
+    if (access(get_database_file_path(backend), F_OK)) {
+        backend = &xml_backend;
+    }
+
+    const char* path = get_database_file_path(backend);
+    Kitty *kitty = backend->load(path);
+    if (!kitty) {
+        fprintf(stderr, "Failed to load %s\n", path);
+        return NULL;
+    }
+
+    if (backend == &xml_backend && kitty->settings->journal) {
+        backend = &journal_backend;
+    }
+
+    kitty->storage = backend;
+    if (backend->open(kitty)) {
+        unload_kitty(kitty);
+        return NULL;
+    }
+
+    return kitty;
+}
+
+int save_kitty(Kitty *kitty)
+{
+    return kitty->storage->commit(kitty);
+}
+
+int checkpoint_kitty(Kitty *kitty)
+{
+    return kitty->storage->checkpoint(kitty);
+}
+
+// the kitty in memory is no longer saved, e.g. after a failed batch
+void discard_kitty(Kitty *kitty)
+{
+    kitty->storage->discard(kitty);
+}
+
+int convert_kitty(Kitty *kitty, const StorageBackend* backend)
+{
+    const StorageBackend* old = kitty->storage;
+    bool journal = kitty->settings->journal;
+
+    // the new snapshot contains everything the old backend has recorded, which
+    // stays in use until the snapshot is written
+    kitty->storage = backend;
+    kitty->settings->journal = backend != &xml_backend;
+    if (backend->checkpoint(kitty)) {
+        // without the journal the new backend may have started
+        if (!journal) {
+            backend->close(kitty);
+        }
+        kitty->storage = old;
+        kitty->settings->journal = journal;
+        return 1;
+    }
+
+    if (strcmp(old->extension, backend->extension) != 0) {
+        remove(get_database_file_path(old));
+        if (strcmp(old->extension, ".xml") == 0) {
+            remove(get_cache_file_path());
+        }
+    }
+    if (backend == &xml_backend) {
+        old->close(kitty);
+        remove(get_journal_file_path());
+    }
+
+    return backend->open(kitty);
+}
+
+void close_kitty(Kitty *kitty)
+{
+    if (kitty->storage) {
+        kitty->storage->close(kitty);
+    }
+}
+
+void unload_kitty(Kitty *kitty)
+{
+    if (kitty->settings) {
+        if (kitty->settings->currency) {
+            currency_free(kitty->settings->currency);
+        }
+        settings_free(kitty->settings);
+    }
+    transaction_log_free(&kitty->transactions);
+    close_kitty(kitty);
+    kitty_free(kitty);
+}
@@ -0,0 +1,403 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+#include "binary.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+    #include <linux/limits.h>
+#elif defined(__APPLE__)
+    #include <sys/syslimits.h>
+#endif
+
+#include "kitty.h"
+#include "storage.h"
+#include "cache.h"
+#include "settings.h"
+#include "currency.h"
+#include "person.h"
+#include "transactions.h"
+
+/*
+ * Storage format 3 lays the database out as fixed-width records, so it can be
+ * mapped into memory and indexed directly:
+ *
+ *   header         settings, kitty, record counts and section offsets
+ *   persons        BinaryPerson[person_count]
+ *   transactions   BinaryTransaction[transaction_count]
+ *   deltas         BinaryDelta[delta_count], grouped by transaction
+ *   strings        NUL-terminated names, referenced by offset
+ *
+ * Delta targets are person ids, -1 is the kitty. All numbers are in host
+ * byte order, the file is not meant to be moved between machines.
+ */
+
+// same values as enum delta_kind
+enum binary_delta_kind {
+    BINARY_BALANCE_DELTA = 0,
+    BINARY_PACKS_DELTA = 1,
+    BINARY_COUNTER_DELTA = 2,
+};
+
+typedef struct BinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    int64_t generation;
+    CacheKey source; // data.xml this file caches, zero otherwise
+
+    char isoname[4];
+    uint8_t prefix;
+    char decimal;
+    uint8_t indent;
+    uint8_t journal;
+    int32_t subunit_digits;
+    int32_t checkpoint_interval;
+
+    int32_t balance;
+    int32_t price;
+    int32_t packs;
+    int32_t counter;
+
+    uint32_t person_count;
+    uint32_t transaction_count;
+    uint32_t delta_count;
+    uint32_t string_size;
+    uint64_t persons_offset;
+    uint64_t transactions_offset;
+    uint64_t deltas_offset;
+    uint64_t strings_offset;
+} BinaryHeader;
+
+enum binary_person_flags {
+    BINARY_PERSON_REMOVED = 1,
+};
+
+typedef struct BinaryPerson {
+    int32_t id;
+    uint32_t flags;
+    uint32_t name_offset;
+    uint32_t name_length;
+    int32_t balance;
+    float thirst;
+    int32_t current_coffees;
+    int32_t total_coffees;
+} BinaryPerson;
+
+typedef struct BinaryTransaction {
+    int64_t timestamp;
+    int32_t type;
+    uint32_t first_delta;
+    uint32_t delta_count;
+    uint32_t reserved;
+} BinaryTransaction;
+
+typedef struct BinaryDelta {
+    int32_t kind;
+    int32_t target;
+    int32_t value;
+} BinaryDelta;
+
+/* loading */
+
+static bool header_is_valid(const BinaryHeader *h, size_t size)
+{
+    if (size < sizeof(BinaryHeader)
+        || memcmp(h->magic, KITTY_BINARY_MAGIC, sizeof(h->magic)) != 0
+        || h->version != KITTY_BINARY_VERSION
+        || h->header_size != sizeof(BinaryHeader)) {
+        return false;
+    }
+
+    return h->persons_offset <= size && (size - h->persons_offset) / sizeof(BinaryPerson) >= h->person_count
+        && h->transactions_offset <= size && (size - h->transactions_offset) / sizeof(BinaryTransaction) >= h->transaction_count
+        && h->deltas_offset <= size && (size - h->deltas_offset) / sizeof(BinaryDelta) >= h->delta_count
+        && h->strings_offset <= size && size - h->strings_offset >= h->string_size
+        && h->persons_offset % 8 == 0 && h->transactions_offset % 8 == 0 && h->deltas_offset % 8 == 0;
+}
+
+int read_binary_source(const char *path, CacheKey *source)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 1;
+    }
+
+    BinaryHeader h;
+    ssize_t length = pread(fd, &h, sizeof(h), 0);
+    close(fd);
+
+    if (length != sizeof(h) || memcmp(h.magic, KITTY_BINARY_MAGIC, sizeof(h.magic)) != 0
+        || h.version != KITTY_BINARY_VERSION) {
+        return 1;
+    }
+
+    *source = h.source;
+    return 0;
+}
+
+static Person* resolve_target(int32_t target, Person **table, int32_t size, bool *failed)
+{
+    if (target < -1 || target >= size || (target >= 0 && !table[target])) {
+        *failed = true;
+        return NULL;
+    }
+    return target == -1 ? NULL : table[target];
+}
+
+static Kitty* kitty_from_image(const unsigned char *image, size_t size)
+{
+    const BinaryHeader *h = (const BinaryHeader*) image;
+    if (!header_is_valid(h, size)) {
+        return NULL;
+    }
+
+    const BinaryPerson *person_records = (const BinaryPerson*) (image + h->persons_offset);
+    const BinaryTransaction *transaction_records = (const BinaryTransaction*) (image + h->transactions_offset);
+    const BinaryDelta *delta_records = (const BinaryDelta*) (image + h->deltas_offset);
+    const char *strings = (const char*) (image + h->strings_offset);
+
+    char isoname[4];
+    memcpy(isoname, h->isoname, sizeof(isoname));
+    isoname[3] = '\0';
+    Settings *settings = settings_alloc(currency_alloc(isoname, h->prefix, h->subunit_digits, h->decimal));
+    settings->checkpoint_interval = h->checkpoint_interval;
+    settings->indent = h->indent;
+    settings->journal = h->journal;
+
+    bool failed = false;
+    Arena *arena = create_arena();
+
+    // persons by id, for resolving the targets of deltas
+    int32_t table_size = 0;
+    for (uint32_t i = 0; i < h->person_count && !failed; i++) {
+        int32_t id = person_records[i].id;
+        failed = id < 0 || id >= PERSON_MAX_ID;
+        if (id >= table_size) {
+            table_size = id + 1;
+        }
+    }
+    Person **table = calloc(failed ? 1 : table_size + 1, sizeof(Person*));
+
+    PersonTable person_table;
+    person_table_init(&person_table);
+    Person *persons = NULL;
+    Person *last_person = NULL;
+    for (uint32_t i = 0; i < h->person_count && !failed; i++) {
+        const BinaryPerson *r = &person_records[i];
+        if ((uint64_t) r->name_offset + r->name_length >= h->string_size || strings[r->name_offset + r->name_length] != '\0'
+            || table[r->id]) {
+            failed = true;
+            break;
+        }
+
+        Person *p = person_create_full(arena, &person_table, (char*) strings + r->name_offset, r->balance,
+            r->thirst, r->current_coffees, r->total_coffees);
+        p->id = r->id;
+        person_table.removed[p->row] = r->flags & BINARY_PERSON_REMOVED;
+        if (last_person) {
+            last_person->next = p;
+        } else {
+            persons = p;
+        }
+        last_person = p;
+        table[r->id] = p;
+    }
+
+    TransactionLog transactions;
+    transaction_log_init(&transactions);
+    transaction_log_reserve(&transactions, h->transaction_count);
+    for (uint32_t i = 0; i < h->transaction_count && !failed; i++) {
+        const BinaryTransaction *r = &transaction_records[i];
+        if ((uint64_t) r->first_delta + r->delta_count > h->delta_count) {
+            failed = true;
+            break;
+        }
+
+        Transaction t;
+        transaction_init(&t, r->type, r->timestamp);
+        for (uint32_t j = 0; j < r->delta_count; j++) {
+            const BinaryDelta *d = &delta_records[r->first_delta + j];
+            Person *target = resolve_target(d->target, table, table_size, &failed);
+            switch (d->kind) {
+            case BINARY_BALANCE_DELTA:
+                transaction_add_delta(&t, arena, BALANCE_DELTA, d->value, target);
+                break;
+            case BINARY_PACKS_DELTA:
+                transaction_add_delta(&t, arena, PACKS_DELTA, d->value, NULL);
+                break;
+            case BINARY_COUNTER_DELTA:
+                transaction_add_delta(&t, arena, COUNTER_DELTA, d->value, target);
+                break;
+            default:
+                failed = true;
+            }
+        }
+        transaction_log_push(&transactions, &t);
+    }
+    free(table);
+
+    if (failed) {
+        arena_free(arena);
+        person_table_free(&person_table);
+        transaction_log_free(&transactions);
+        currency_free(settings->currency);
+        settings_free(settings);
+        return NULL;
+    }
+
+    Kitty *kitty = create_kitty(h->balance, h->price, h->packs, h->counter, settings, persons, &person_table, &transactions, arena);
+    kitty->generation = h->generation;
+    return kitty;
+}
+
+Kitty *load_kitty_from_binary(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t) sizeof(BinaryHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+
+    Kitty *kitty = kitty_from_image(image, st.st_size);
+    munmap(image, st.st_size);
+
+    return kitty;
+}
+
+/* saving */
+
+static uint64_t align8(uint64_t offset)
+{
+    return (offset + 7) & ~(uint64_t) 7;
+}
+
+static void write_padding(FILE *file, uint64_t from, uint64_t to)
+{
+    static const char zeros[8] = {0};
+    fwrite(zeros, 1, to - from, file);
+}
+
+int save_kitty_to_binary(const char *path, const Kitty *kitty, const CacheKey *source)
+{
+    BinaryHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, KITTY_BINARY_MAGIC, sizeof(h.magic));
+    h.version = KITTY_BINARY_VERSION;
+    h.header_size = sizeof(BinaryHeader);
+    h.generation = kitty->generation;
+    if (source) {
+        h.source = *source;
+    }
+
+    const Currency *currency = kitty->settings->currency;
+    memcpy(h.isoname, currency->isoname, sizeof(h.isoname));
+    h.prefix = currency->prefix;
+    h.decimal = currency->decimal;
+    h.subunit_digits = currency->subunit_digits;
+    h.checkpoint_interval = kitty->settings->checkpoint_interval;
+    h.indent = kitty->settings->indent;
+    h.journal = kitty->settings->journal;
+
+    h.balance = kitty->balance.value;
+    h.price = kitty->price.value;
+    h.packs = kitty->packs;
+    h.counter = kitty->counter;
+
+    // sizes of the sections
+    for (const Person *p = kitty->persons; p; p = p->next) {
+        h.person_count++;
+        h.string_size += p->name_length + 1;
+    }
+    h.transaction_count = kitty->transactions.length;
+    for (size_t i = 0; i < kitty->transactions.length; i++) {
+        h.delta_count += kitty->transactions.items[i].delta_count;
+    }
+    h.persons_offset = align8(sizeof(BinaryHeader));
+    h.transactions_offset = align8(h.persons_offset + (uint64_t) h.person_count * sizeof(BinaryPerson));
+    h.deltas_offset = align8(h.transactions_offset + (uint64_t) h.transaction_count * sizeof(BinaryTransaction));
+    h.strings_offset = h.deltas_offset + (uint64_t) h.delta_count * sizeof(BinaryDelta);
+
+    char temp_path[PATH_MAX];
+    FILE *file = atomic_open(path, temp_path, sizeof(temp_path));
+    if (!file) {
+        return 1;
+    }
+
+    fwrite(&h, sizeof(h), 1, file);
+    write_padding(file, sizeof(h), h.persons_offset);
+
+    uint32_t name_offset = 0;
+    const PersonTable *table = &kitty->person_table;
+    for (const Person *p = kitty->persons; p; p = p->next) {
+        int row = p->row;
+        BinaryPerson r = {p->id, table->removed[row] ? BINARY_PERSON_REMOVED : 0, name_offset, p->name_length,
+            table->balance[row].value, table->thirst[row], table->current_coffees[row], table->total_coffees[row]};
+        fwrite(&r, sizeof(r), 1, file);
+        name_offset += p->name_length + 1;
+    }
+    write_padding(file, h.persons_offset + (uint64_t) h.person_count * sizeof(BinaryPerson), h.transactions_offset);
+
+    uint32_t first_delta = 0;
+    for (size_t i = 0; i < kitty->transactions.length; i++) {
+        const Transaction *t = &kitty->transactions.items[i];
+        BinaryTransaction r = {t->timestamp, t->type, first_delta, t->delta_count, 0};
+        fwrite(&r, sizeof(r), 1, file);
+        first_delta += r.delta_count;
+    }
+    write_padding(file, h.transactions_offset + (uint64_t) h.transaction_count * sizeof(BinaryTransaction), h.deltas_offset);
+
+    for (size_t i = 0; i < kitty->transactions.length; i++) {
+        const Transaction *t = &kitty->transactions.items[i];
+        const Delta *deltas = transaction_deltas(t);
+        for (int j = 0; j < t->delta_count; j++) {
+            const Delta *d = &deltas[j];
+            BinaryDelta r = {d->kind, d->target ? d->target->id : -1, d->value};
+            fwrite(&r, sizeof(r), 1, file);
+        }
+    }
+
+    for (const Person *p = kitty->persons; p; p = p->next) {
+        fwrite(p->name, 1, p->name_length + 1, file);
+    }
+
+    int failed = atomic_commit(file, temp_path, path);
+    if (failed) {
+        fprintf(stderr, "Failed to write %s\n", path);
+    }
+    return failed;
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "kitty.h"
+#include "binary.h"
+
+/*
+ * data.bin is a binary image (see binary.c) of data.xml, whose header records the
+ * CacheKey of the data.xml it was created from. It is only used as long as
+ * that key matches the current data.xml.
+ */
+
+/* key */
+
+static int cache_stat_file(const char *path, CacheKey *key)
+{
+    struct stat st;
+    if (stat(path, &st)) {
+        return 1;
+    }
+
+    key->size = st.st_size;
+    key->mtime_sec = st.st_mtime;
+#if defined(__APPLE__)
+    key->mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    key->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    key->hash = 0;
+    return 0;
+}
+
+static int cache_hash_file(const char *path, uint64_t *hash)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 1;
+    }
+
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    unsigned char buffer[65536];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        for (size_t i = 0; i < length; i++) {
+            h ^= buffer[i];
+            h *= 1099511628211ULL;
+        }
+    }
+
+    bool failed = ferror(file);
+    fclose(file);
+    *hash = h;
+    return failed;
+}
+
+int cache_key_of_file(const char *path, CacheKey *key)
+{
+    if (cache_stat_file(path, key)) {
+        return 1;
+    }
+    return cache_hash_file(path, &key->hash);
+}
+
+/* loading */
+
+static bool cache_is_current(const CacheKey *cached, const char *xml_path)
+{
+    // only hash data.xml if the cheap checks pass
+    CacheKey current;
+    if (cache_stat_file(xml_path, &current)
+        || current.size != cached->size
+        || current.mtime_sec != cached->mtime_sec
+        || current.mtime_nsec != cached->mtime_nsec) {
+        return false;
+    }
+    return !cache_hash_file(xml_path, &current.hash) && current.hash == cached->hash;
+}
+
+Kitty *load_kitty_from_cache(const char *cache_path, const char *xml_path)
+{
+    CacheKey cached;
+    if (read_binary_source(cache_path, &cached) || !cache_is_current(&cached, xml_path)) {
+        return NULL;
+    }
+
+    return load_kitty_from_binary(cache_path);
+}
+
+/* saving */
+
+int save_kitty_to_cache(const char *cache_path, const char *xml_path, const Kitty *kitty)
+{
+    CacheKey key;
+    if (cache_key_of_file(xml_path, &key)) {
+        return 1;
+    }
+
+    return save_kitty_to_binary(cache_path, kitty, &key);
+}
@@ -0,0 +1,594 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#if defined(__APPLE__)
+    #define purge_stdin() fpurge(stdin)
+#else
+    #include <stdio_ext.h>
+    #define purge_stdin() __fpurge(stdin)
+#endif
+
+#include "kitty.h"
+#include "storage.h"
+#include "backend.h"
+#include "commands.h"
+#include "protocol.h"
+
+// Changes are applied right away, but saved in groups: a group is committed
+// this long after its first change ...
+#define DAEMON_COMMIT_WINDOW_MS 10
+// ... or once it has this many commands. Clients are only answered after
+// their changes have been saved.
+#define DAEMON_COMMIT_SIZE 64
+#define DAEMON_MAX_COMMIT_WINDOW_MS 60000
+#define DAEMON_MAX_COMMIT_SIZE 1024
+// Clients are served one at a time, so reading the request of a client fails
+// if it blocks longer than this, as clients send it right after connecting ...
+#define DAEMON_REQUEST_TIMEOUT_MS 100
+// ... and reading its stdin, e.g. of a batch, if it blocks longer than this.
+// Replies are buffered and sent whenever the client is ready for them, only
+// when the daemon stops it waits this long for each client to take the rest.
+#define DAEMON_CLIENT_TIMEOUT_MS 1000
+
+// a connection and the part of its reply that has not been sent yet
+typedef struct Client {
+    int fd;
+    char *reply;
+    size_t length;
+    size_t capacity;
+    size_t sent;
+    bool answered; // the reply ends with the status
+} Client;
+
+// clients waiting for their changes to be saved
+typedef struct CommitGroup {
+    Client **clients;
+    int *rvals;
+    int count;
+    int size; // commit at this many clients
+    long window; // ms
+    long since; // first change
+} CommitGroup;
+
+// A kitty held in memory. Kitties are loaded on their first command and kept
+// locked until the daemon stops, each one is committed on its own.
+typedef struct DaemonKitty {
+    char name[KITTY_NAME_MAX + 1]; // empty for the default kitty
+    Kitty *kitty; // NULL if it could not be reloaded
+    int lock;
+    CommitGroup group;
+} DaemonKitty;
+
+typedef struct Daemon {
+    DaemonKitty **kitties;
+    int count;
+    long window; // of the commit groups
+    long size;
+    Client **clients;
+    int client_count;
+    int output; // file the output of commands goes to
+} Daemon;
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signal)
+{
+    (void)signal;
+    running = 0;
+}
+
+static long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int listen_socket(const char* path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int running_daemon = connect_daemon();
+    if (running_daemon >= 0) {
+        close(running_daemon);
+        fprintf(stderr, "coffeekittyd is already running\n");
+        return -1;
+    }
+    unlink(path); // left behind by a daemon that was killed
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create socket\n");
+        return -1;
+    }
+
+    // only the owner of the database may talk to the daemon
+    mode_t mask = umask(0077);
+    int failed = bind(fd, (struct sockaddr*) &address, sizeof(address)) || listen(fd, 16);
+    umask(mask);
+    if (failed) {
+        fprintf(stderr, "Failed to listen on %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static Client* add_client(Daemon* daemon, int fd)
+{
+    Client* c = malloc(sizeof(Client));
+    *c = (Client) {fd, NULL, 0, 0, 0, false};
+    daemon->clients = realloc(daemon->clients, sizeof(Client*) * (daemon->client_count + 1));
+    daemon->clients[daemon->client_count++] = c;
+    return c;
+}
+
+static void reply(Client* c, const char* data, size_t length)
+{
+    if (c->length + length > c->capacity) {
+        c->capacity = c->capacity ? c->capacity : 4096;
+        while (c->length + length > c->capacity)
+            c->capacity *= 2;
+        c->reply = realloc(c->reply, c->capacity);
+    }
+    memcpy(c->reply + c->length, data, length);
+    c->length += length;
+}
+
+static void acknowledge(Client* c, int rval)
+{
+    char status[2] = {'\0', (char) rval};
+    reply(c, status, sizeof(status));
+    c->answered = true;
+}
+
+// Sends as much of the reply as the client takes without blocking. Returns
+// false once the client is done with, because it got everything or is gone.
+static bool send_reply(Client* c)
+{
+    while (c->sent < c->length) {
+        ssize_t written = send(c->fd, c->reply + c->sent, c->length - c->sent, MSG_DONTWAIT);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (written <= 0)
+            return false;
+        c->sent += written;
+    }
+    return !c->answered;
+}
+
+static void close_client(Client* c)
+{
+    close(c->fd);
+    free(c->reply);
+    free(c);
+}
+
+// moves everything the command wrote to the output file into the reply
+static void capture_output(Client* c, int output)
+{
+    off_t length = lseek(output, 0, SEEK_END);
+    char buffer[4096];
+    for (off_t offset = 0; offset < length;) {
+        ssize_t chunk = pread(output, buffer, sizeof(buffer), offset);
+        if (chunk <= 0)
+            break;
+        reply(c, buffer, chunk);
+        offset += chunk;
+    }
+
+    if (ftruncate(output, 0) || lseek(output, 0, SEEK_SET)) {
+        fprintf(stderr, "Failed to clear the output of the last command\n");
+    }
+}
+
+// Loads the selected kitty again, e.g. to drop changes that could not be
+// saved. If that fails, the kitty is unlocked until its next command.
+static void reload_kitty(DaemonKitty* k)
+{
+    unload_kitty(k->kitty);
+    k->kitty = load_kitty();
+    if (!k->kitty) {
+        fprintf(stderr, "Failed to reload database\n");
+        unlock_database(k->lock);
+        k->lock = -1;
+    }
+}
+
+// Saves the changes of the group of the kitty and answers its clients. If
+// saving fails, the changes are dropped by reloading the database.
+static int commit(DaemonKitty* k)
+{
+    CommitGroup* group = &k->group;
+    select_kitty(k->name);
+    int failed = save_kitty(k->kitty);
+    if (failed) {
+        fprintf(stderr, "Failed to save database, dropping the changes of %i commands\n", group->count);
+        reload_kitty(k);
+    }
+
+    for (int i = 0; i < group->count; i++) {
+        if (failed) {
+            const char message[] = "Failed to save database, the command had no effect\n";
+            reply(group->clients[i], message, sizeof(message) - 1);
+        }
+        acknowledge(group->clients[i], failed ? 1 : group->rvals[i]);
+    }
+    group->count = 0;
+
+    return failed;
+}
+
+// Selects the kitty and loads it, unless it is in memory already. Returns
+// NULL if it can not be locked or loaded.
+static DaemonKitty* open_kitty(Daemon* daemon, const char* name)
+{
+    if (select_kitty(name)) {
+        fprintf(stderr, "Invalid kitty name %s\n", name);
+        return NULL;
+    }
+
+    DaemonKitty* k = NULL;
+    for (int i = 0; i < daemon->count; i++) {
+        if (strcmp(daemon->kitties[i]->name, name) == 0) {
+            k = daemon->kitties[i];
+            break;
+        }
+    }
+    if (k && k->kitty) {
+        return k;
+    }
+
+    if (!k) {
+        k = malloc(sizeof(DaemonKitty));
+        snprintf(k->name, sizeof(k->name), "%s", name);
+        k->kitty = NULL;
+        k->lock = -1;
+        k->group = (CommitGroup) {malloc(sizeof(Client*) * daemon->size), malloc(sizeof(int) * daemon->size),
+            0, daemon->size, daemon->window, 0};
+        daemon->kitties = realloc(daemon->kitties, sizeof(DaemonKitty*) * (daemon->count + 1));
+        daemon->kitties[daemon->count++] = k;
+    }
+
+    // the daemon owns the database until it stops, but does not wait for it
+    // while the commands for the other kitties queue up behind this one
+    if (k->lock < 0) {
+        k->lock = lock_database(true, 0);
+        if (k->lock < 0) {
+            return NULL;
+        }
+    }
+    if (!database_exists() && create_database()) {
+        return NULL;
+    }
+    k->kitty = load_kitty();
+    return k->kitty ? k : NULL;
+}
+
+static void close_kitties(Daemon* daemon)
+{
+    for (int i = 0; i < daemon->count; i++) {
+        DaemonKitty* k = daemon->kitties[i];
+        if (k->kitty) {
+            unload_kitty(k->kitty);
+        }
+        if (k->lock >= 0) {
+            unlock_database(k->lock);
+        }
+        free(k->group.clients);
+        free(k->group.rvals);
+        free(k);
+    }
+    free(daemon->kitties);
+}
+
+// Runs the command with stdin redirected to the client, and stdout and stderr
+// to the output file.
+// The kitty it wrote to, if any, is returned in target.
+static int run_command(int argc, char** argv, const char* cwd, const char* name, Daemon* daemon, DaemonKitty** target)
+{
+    const Command* command = find_command(argc, argv);
+    if (!command) {
+        printf("Command %s not found.\n Try %s help\n", argv[1], argv[0]);
+        return 1;
+    }
+
+    if (chdir(cwd)) {
+        printf("Failed to change to directory %s\n", cwd);
+        return 1;
+    }
+
+    if (command->access == COMMAND_NO_KITTY) {
+        return command->function(argc, argv, NULL);
+    }
+
+    // the client asks the question, waiting for the answer would block everyone
+    if (command_asks(argc, argv)) {
+        printf("%s needs --yes when run by coffeekittyd\n", command->name);
+        return 1;
+    }
+
+    DaemonKitty* k = open_kitty(daemon, name);
+    if (!k) {
+        return 1;
+    }
+
+    // a failed batch discards what it recorded, which must not include earlier commands
+    bool batch = command->function == command_batch;
+    if (batch && k->group.count && commit(k)) {
+        printf("Failed to save database\n");
+        return 1;
+    }
+    select_kitty(k->name);
+    int rval = command->function(argc, argv, k->kitty);
+    *target = command->access >= COMMAND_APPENDS ? k : NULL;
+
+    // the kitty in memory still contains the changes of the failed batch
+    if (batch && rval) {
+        reload_kitty(k);
+        *target = NULL;
+    }
+
+    return rval;
+}
+
+static void set_timeout(int fd, int option, long ms)
+{
+    struct timeval timeout = {ms / 1000, ms % 1000 * 1000};
+    setsockopt(fd, SOL_SOCKET, option, &timeout, sizeof(timeout));
+}
+
+// the client is answered right away, or after the commit of its changes
+static void handle_connection(int fd, Daemon* daemon)
+{
+    set_timeout(fd, SO_RCVTIMEO, DAEMON_REQUEST_TIMEOUT_MS);
+
+    int argc;
+    char* cwd;
+    char* name;
+    char** argv = recv_request(fd, &argc, &cwd, &name);
+    if (!argv) {
+        fprintf(stderr, "Ignoring invalid request\n");
+        close(fd);
+        return;
+    }
+    set_timeout(fd, SO_RCVTIMEO, DAEMON_CLIENT_TIMEOUT_MS);
+
+    fflush(stdout);
+    fflush(stderr);
+    int saved[3] = {dup(STDIN_FILENO), dup(STDOUT_FILENO), dup(STDERR_FILENO)};
+    dup2(fd, STDIN_FILENO);
+    dup2(daemon->output, STDOUT_FILENO);
+    dup2(daemon->output, STDERR_FILENO);
+    // nothing read from the previous client may leak into this one
+    purge_stdin();
+    clearerr(stdin);
+
+    DaemonKitty* target = NULL;
+    int rval = run_command(argc, argv, cwd, name, daemon, &target);
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++) {
+        dup2(saved[i], i);
+        close(saved[i]);
+    }
+    purge_stdin();
+    clearerr(stdin);
+    if (chdir("/")) {
+        fprintf(stderr, "Failed to change to directory /\n");
+    }
+
+    free_request(argc, argv, cwd, name);
+
+    Client* c = add_client(daemon, fd);
+    capture_output(c, daemon->output);
+    if (!target) {
+        acknowledge(c, rval);
+        return;
+    }
+
+    CommitGroup* group = &target->group;
+    if (group->count == 0) {
+        group->since = now_ms();
+    }
+    group->clients[group->count] = c;
+    group->rvals[group->count] = rval;
+    group->count++;
+}
+
+// Commits the groups that are due. Returns the time until the next one is,
+// -1 if no client is waiting.
+static long commit_due(Daemon* daemon)
+{
+    long timeout = -1;
+    long now = now_ms();
+    for (int i = 0; i < daemon->count; i++) {
+        CommitGroup* group = &daemon->kitties[i]->group;
+        if (group->count == 0) {
+            continue;
+        }
+
+        long remaining = group->since + group->window - now;
+        if (remaining <= 0 || group->count >= group->size) {
+            commit(daemon->kitties[i]);
+        } else if (timeout < 0 || remaining < timeout) {
+            timeout = remaining;
+        }
+    }
+    return timeout;
+}
+
+static int parse_option(const char* value, long min, long max, long* option)
+{
+    char* end;
+    long parsed = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || parsed < min || parsed > max) {
+        return 1;
+    }
+    *option = parsed;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long window = DAEMON_COMMIT_WINDOW_MS;
+    long size = DAEMON_COMMIT_SIZE;
+    for (int i = 1; i < argc; i += 2) {
+        bool valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--commit-window") == 0) {
+            valid = !parse_option(argv[i + 1], 0, DAEMON_MAX_COMMIT_WINDOW_MS, &window);
+        } else if (valid && strcmp(argv[i], "--commit-size") == 0) {
+            valid = !parse_option(argv[i + 1], 1, DAEMON_MAX_COMMIT_SIZE, &size);
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            printf("Usage: %s [--commit-window <ms>] [--commit-size <commands>]\n"
+                   "Keeps the coffeekitty databases in memory and runs the commands of coffeekitty.\n"
+                   "Changes are saved at most <ms> (default %i) after they were made, or once\n"
+                   "<commands> (default %i) commands are waiting for it.\n",
+                   argv[0], DAEMON_COMMIT_WINDOW_MS, DAEMON_COMMIT_SIZE);
+            return 1;
+        }
+    }
+
+    // the default kitty is loaded right away, the named ones on demand
+    Daemon daemon = {NULL, 0, window, size, NULL, 0, -1};
+    if (!open_kitty(&daemon, "")) {
+        close_kitties(&daemon);
+        return 1;
+    }
+
+    FILE* output = tmpfile();
+    if (!output) {
+        fprintf(stderr, "Failed to create a file for the output of commands\n");
+        close_kitties(&daemon);
+        return 1;
+    }
+    daemon.output = fileno(output);
+
+    const char* path = get_socket_file_path();
+    int listener = listen_socket(path);
+    if (listener < 0) {
+        fclose(output);
+        close_kitties(&daemon);
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "Listening on %s\n", path);
+
+    int rval = 0;
+
+    struct pollfd* fds = NULL;
+    while (running) {
+        int timeout = commit_due(&daemon);
+
+        // send what the clients take, and wait for the rest until they are ready
+        fds = realloc(fds, sizeof(struct pollfd) * (daemon.client_count + 1));
+        fds[0] = (struct pollfd) {listener, POLLIN, 0};
+        int nfds = 1;
+        int kept = 0;
+        for (int i = 0; i < daemon.client_count; i++) {
+            Client* c = daemon.clients[i];
+            if (!send_reply(c)) {
+                close_client(c);
+                continue;
+            }
+            daemon.clients[kept++] = c;
+            if (c->sent < c->length) {
+                fds[nfds++] = (struct pollfd) {c->fd, POLLOUT, 0};
+            }
+        }
+        daemon.client_count = kept;
+
+        int ready = poll(fds, nfds, timeout);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Failed to wait for connections\n");
+            rval = 1;
+            break;
+        }
+
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        handle_connection(fd, &daemon);
+    }
+    free(fds);
+
+    close(listener);
+    unlink(path);
+
+    for (int i = 0; i < daemon.count; i++) {
+        if (daemon.kitties[i]->group.count) {
+            rval |= commit(daemon.kitties[i]);
+        }
+    }
+    close_kitties(&daemon);
+
+    // the clients still get their replies, unless they keep us waiting
+    for (int i = 0; i < daemon.client_count; i++) {
+        Client* c = daemon.clients[i];
+        set_timeout(c->fd, SO_SNDTIMEO, DAEMON_CLIENT_TIMEOUT_MS);
+        send_all(c->fd, c->reply + c->sent, c->length - c->sent);
+        close_client(c);
+    }
+    free(daemon.clients);
+    fclose(output);
+
+    return rval;
+}
@@ -20,6 +20,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
 
 #include "kitty.h"
 #include "person.h"
@@ -32,40 +34,45 @@
 #include "operations.h"
 #include "latex.h"
 #include "transactions.h"
+#include "backend.h"
 
 const Command commands[] = {
-    {"#", NULL, "General:"},
-    {"print", command_print, "Print table (default)"},
-    {"help", command_help, "Print help"},
-    {"about", command_about, "Print about/version information"},
-    {"version", command_about, "Print about/version information"},
-
-    {"#", NULL, "Kitty management:"},
-    {"set", command_set, "Set various settings"},
-
-    {"#", NULL, "  Transaction management:"},
-    {"drink", command_drink, "Drink coffee"},
-    {"buy", command_buy, "Buy coffee"},
-    {"pay", command_pay, "(Person) Pay(s) debt"},
-    {"reimbursement", command_reimbursement, "(Person) Buy(s) something for the kitty"},
-    {"consume", command_consume, "Consume a pack"},
-    {"undo", command_undo, "Undo last transaction"},
-
-    {"#", NULL, "  Output management:"},
-    {"latex", command_latex, "Print latex sheet"},
-    {"thirst", command_thirst, "Calculate thirst"},
-
-    {"#", NULL, "  Person management:"},
-    {"add", command_add, "Add a person"},
-    {"remove", command_remove, "Remove a person"},
-    {"rename", command_rename, "Rename a person"},
-
-    {NULL, NULL, NULL}
+    {"#", NULL, "General:", COMMAND_NO_KITTY},
+    {"print", command_print, "Print table (default)", COMMAND_READS},
+    {"help", command_help, "Print help", COMMAND_NO_KITTY},
+    {"about", command_about, "Print about/version information", COMMAND_NO_KITTY},
+    {"version", command_about, "Print about/version information", COMMAND_NO_KITTY},
+
+    {"#", NULL, "Kitty management:", COMMAND_NO_KITTY},
+    {"set", command_set, "Set various settings", COMMAND_WRITES},
+    {"checkpoint", command_checkpoint, "Fold the journal into the database", COMMAND_WRITES},
+    {"convert", command_convert, "Switch the storage backend", COMMAND_WRITES},
+    {"batch", command_batch, "Run commands from a file (or - for stdin), one per line", COMMAND_WRITES},
+
+    {"#", NULL, "  Transaction management:", COMMAND_NO_KITTY},
+    {"drink", command_drink, "Drink coffee", COMMAND_APPENDS},
+    {"buy", command_buy, "Buy coffee", COMMAND_APPENDS},
+    {"pay", command_pay, "(Person) Pay(s) debt", COMMAND_APPENDS},
+    {"reimbursement", command_reimbursement, "(Person) Buy(s) something for the kitty", COMMAND_APPENDS},
+    {"consume", command_consume, "Consume a pack", COMMAND_APPENDS},
+    {"undo", command_undo, "Undo last transaction", COMMAND_WRITES},
+
+    {"#", NULL, "  Output management:", COMMAND_NO_KITTY},
+    {"latex", command_latex, "Print latex sheet", COMMAND_READS},
+    {"thirst", command_thirst, "Calculate thirst", COMMAND_WRITES},
+    {"history", command_history, "Print transactions, optionally --since/--until <YYYY-MM-DD>", COMMAND_READS},
+
+    {"#", NULL, "  Person management:", COMMAND_NO_KITTY},
+    {"add", command_add, "Add a person", COMMAND_WRITES},
+    {"remove", command_remove, "Remove a person (--purge: with all transactions, --yes: without asking)", COMMAND_WRITES},
+    {"rename", command_rename, "Rename a person", COMMAND_WRITES},
+
+    {NULL, NULL, NULL, COMMAND_NO_KITTY}
 };
 
 void print_commands(char* argv0)
 {
-    printf("Usage: %s <operation> [options...]\n", argv0);
+    printf("Usage: %s [-k <kitty>] [--optimistic] <operation> [options...]\n", argv0);
     printf("Operations:\n");
     for (int cptr = 0; commands[cptr].name; cptr++) {
         const Command* c = &commands[cptr];
@@ -79,10 +86,10 @@ void print_commands(char* argv0)
     }
 }
 
-int parse_command(int argc, char** argv, Kitty* kitty)
+const Command* find_command(int argc, char** argv)
 {
     if (argc < 2) {
-        return commands[1].function(argc, argv, kitty);
+        return &commands[1];
     }
 
     for (int cptr = 0; commands[cptr].name; cptr++) {
@@ -92,12 +99,22 @@ int parse_command(int argc, char** argv, Kitty* kitty)
             continue;
 
         if (strcmp(argv[1], c->name) == 0) {
-            return c->function(argc, argv, kitty);
+            return c;
         }
     }
 
-    printf("Command %s not found.\n Try %s help\n", argv[1], argv[0]);
-    return 1;
+    return NULL;
+}
+
+int parse_command(int argc, char** argv, Kitty* kitty)
+{
+    const Command* c = find_command(argc, argv);
+    if (!c) {
+        printf("Command %s not found.\n Try %s help\n", argv[1], argv[0]);
+        return 1;
+    }
+
+    return c->function(argc, argv, kitty);
 }
 
 /* General */
@@ -105,11 +122,12 @@ int parse_command(int argc, char** argv, Kitty* kitty)
 int command_print(int argc, char** argv, Kitty* kitty)
 {
     if (argc > 2) {
-        Person* p = get_person_by_name(kitty->persons, argv[2]);
+        Person* p = kitty_find_person(kitty, argv[2]);
         if (p) {
-            fprint_person(stdout, p);
+            fprint_person(stdout, kitty, p);
         } else {
             printf("Person not found\n");
+            return 1;
         }
     }
     else { // no additional argument given
@@ -149,7 +167,7 @@ int command_set(int argc, char** argv, Kitty* kitty)
 {
     if (argc < 3 || argc > 4) {
         printf("Usage: %s %s <option> <value>\n", argv[0], argv[1]);
-        printf("Available options are:\n\tprice\n\tbalance\n\tpacks\n\tcurrency\n\tprefix_currency_value\n");
+        printf("Available options are:\n\tprice\n\tbalance\n\tpacks\n\tcurrency\n\tprefix_currency_value\n\tcheckpoint_interval\n\tindent_database\n");
         return 1;
     }
 
@@ -159,20 +177,16 @@ int command_set(int argc, char** argv, Kitty* kitty)
             return 1;
         }
         Currency* currency = kitty->settings->currency;
-        CurrencyValue* price = ftocv(atof(argv[3]), currency);
-        currency_value_free(kitty->price);
-        kitty->price = price;
-        printf("Price set to %s\n", currency_value_format(price, false, true));
+        kitty->price = ftocv(atof(argv[3]), currency);
+        printf("Price set to %s\n", currency_value_format(kitty->price, currency, false, true));
     } else if (strcmp(argv[2], "balance") == 0) {
         if (argc < 4) {
             printf("Usage: %s %s balance <value>\n", argv[0], argv[1]);
             return 1;
         }
         Currency* currency = kitty->settings->currency;
-        CurrencyValue* balance = ftocv(atof(argv[3]), currency);
-        currency_value_free(kitty->balance);
-        kitty->balance = balance;
-        printf("Balance set to %s\n", currency_value_format(balance, true, true));
+        kitty->balance = ftocv(atof(argv[3]), currency);
+        printf("Balance set to %s\n", currency_value_format(kitty->balance, currency, true, true));
     } else if (strcmp(argv[2], "packs") == 0) {
         if (argc < 4) {
             printf("Usage: %s %s packs <value>\n", argv[0], argv[1]);
@@ -205,14 +219,246 @@ int command_set(int argc, char** argv, Kitty* kitty)
         }
 
         printf("Prefix currency value set to %s\n", kitty->settings->currency->prefix ? "true" : "false");
+    } else if (strcmp(argv[2], "checkpoint_interval") == 0) {
+        if (argc < 4) {
+            printf("Usage: %s %s checkpoint_interval <transactions>\n", argv[0], argv[1]);
+            return 1;
+        }
+        kitty->settings->checkpoint_interval = atoi(argv[3]);
+        printf("Checkpoint interval set to %i\n", kitty->settings->checkpoint_interval);
+    } else if (strcmp(argv[2], "indent_database") == 0) {
+        if (argc < 4) {
+            printf("Usage: %s %s indent_database <true|false>\n", argv[0], argv[1]);
+            return 1;
+        }
+
+        if (strcmp(argv[3], "true") == 0 || argv[3][0] == '1') {
+            kitty->settings->indent = true;
+        } else if (strcmp(argv[3], "false") == 0 || argv[3][0] == '0') {
+            kitty->settings->indent = false;
+        } else {
+            printf("Unknown value %s\n", argv[3]);
+            return 1;
+        }
+
+        printf("Indent database set to %s\n", kitty->settings->indent ? "true" : "false");
     } else {
         printf("Unknown setting %s\n", argv[2]);
         return 1;
     }
 
+    kitty->dirty = true;
     return 0;
 }
 
+int command_checkpoint(int argc, char** argv, Kitty* kitty)
+{
+    if (argc != 2) {
+        printf("Usage: %s %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    // the database is rewritten on exit
+    kitty->dirty = true;
+    return 0;
+}
+
+int command_convert(int argc, char** argv, Kitty* kitty)
+{
+    if (argc != 3) {
+        printf("Usage: %s %s <xml|journal|binary>\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    const StorageBackend* backend = find_storage_backend(argv[2]);
+    if (!backend) {
+        printf("Unknown storage backend %s\n", argv[2]);
+        return 1;
+    }
+
+    if (convert_kitty(kitty, backend)) {
+        printf("Failed to convert database to %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("Database converted to %s\n", argv[2]);
+    return 0;
+}
+
+// options of remove, returns the index of the first name, or -1 for an unknown option
+static int parse_remove_options(int argc, char** argv, bool* purge, bool* yes)
+{
+    *purge = false;
+    *yes = false;
+    int i = 2;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        if (strcmp(argv[i], "--purge") == 0) {
+            *purge = true;
+        } else if (strcmp(argv[i], "--yes") == 0) {
+            *yes = true;
+        } else {
+            return -1;
+        }
+    }
+    return i;
+}
+
+// remove asks before it changes anything, unless it is given --yes or
+// nothing to remove, which only prints its usage
+bool command_asks(int argc, char** argv)
+{
+    bool purge, yes;
+    const Command* c = find_command(argc, argv);
+    if (!c || c->function != command_remove) {
+        return false;
+    }
+    int first = parse_remove_options(argc, argv, &purge, &yes);
+    return first >= 0 && first < argc && !yes;
+}
+
+// Asks the question of remove for all names at once, e.g. before the command
+// is sent to coffeekittyd, which can not wait for the answer.
+bool confirm_command(int argc, char** argv)
+{
+    bool purge, yes;
+    int first = parse_remove_options(argc, argv, &purge, &yes);
+
+    printf("Are you sure you want to %s ", purge ? "purge" : "remove");
+    for (int i = first; i < argc; i++) {
+        printf("%s%s", argv[i], i + 1 < argc ? ", " : "?\n");
+    }
+    if (purge) {
+        printf("This will remove all transactions related to them.\n"
+               "THIS ACTION CANNOT BE UNDONE. (y/N): ");
+    } else {
+        printf("Their transactions are kept, adding them again brings them back. (y/N): ");
+    }
+    fflush(stdout);
+
+    int answer = getchar();
+    for (int c = answer; c != '\n' && c != EOF; c = getchar()); // clear input buffer
+    if (answer != 'y' && answer != 'Y') {
+        printf("Aborting removal\n");
+        return false;
+    }
+    return true;
+}
+
+// Splits a batch line into words, which may be quoted with "" or ''.
+// Returns the number of words, or -1 for an unterminated quote.
+static int split_batch_line(char* line, char*** words, int* capacity)
+{
+    int count = 0;
+    char* in = line;
+
+    while (true) {
+        while (*in == ' ' || *in == '\t' || *in == '\n' || *in == '\r')
+            in++;
+        if (*in == '\0' || *in == '#')
+            return count;
+
+        if (count == *capacity) {
+            *capacity = *capacity ? 2 * *capacity : 8;
+            *words = realloc(*words, *capacity * sizeof(char*));
+        }
+
+        // words are unquoted in place
+        char* out = in;
+        (*words)[count++] = out;
+        char quote = '\0';
+        while (*in && (quote || (*in != ' ' && *in != '\t' && *in != '\n' && *in != '\r'))) {
+            if (quote && *in == quote) {
+                quote = '\0';
+            } else if (!quote && (*in == '"' || *in == '\'')) {
+                quote = *in;
+            } else {
+                *out++ = *in;
+            }
+            in++;
+        }
+        if (quote)
+            return -1;
+        if (*in)
+            in++;
+        *out = '\0';
+    }
+}
+
+int command_batch(int argc, char** argv, Kitty* kitty)
+{
+    if (argc != 3) {
+        printf("Usage: %s %s <file|->\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    FILE* file = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "r");
+    if (!file) {
+        printf("Failed to open %s\n", argv[2]);
+        return 1;
+    }
+
+    char* line = NULL;
+    size_t size = 0;
+    char** words = NULL;
+    int capacity = 0;
+    int lineno = 0;
+    int rval = 0;
+
+    while (rval == 0 && getline(&line, &size, file) != -1) {
+        lineno++;
+
+        // words[0] takes the place of argv[0]
+        int count = split_batch_line(line, &words, &capacity);
+        if (count < 0) {
+            printf("Unterminated quote\n");
+            rval = 1;
+            break;
+        }
+        if (count == 0)
+            continue;
+
+        char* batch_argv[count + 2];
+        batch_argv[0] = argv[0];
+        memcpy(batch_argv + 1, words, count * sizeof(char*));
+        batch_argv[count + 1] = NULL;
+
+        // both write the database on their own
+        const Command* c = find_command(count + 1, batch_argv);
+        if (c && (c->function == command_batch || c->function == command_convert)) {
+            printf("%s cannot be used in a batch\n", c->name);
+            rval = 1;
+            break;
+        }
+
+        // a confirmation would be read from the batch itself
+        if (command_asks(count + 1, batch_argv)) {
+            printf("remove needs --yes in a batch\n");
+            rval = 1;
+            break;
+        }
+
+        rval = parse_command(count + 1, batch_argv, kitty);
+    }
+
+    // e.g. coffeekittyd gave up waiting for the rest of stdin
+    if (rval == 0 && ferror(file)) {
+        printf("Failed to read %s\n", argv[2]);
+        rval = 1;
+    }
+
+    if (rval) {
+        // all or nothing
+        printf("Batch failed at line %i, nothing was saved\n", lineno);
+        discard_kitty(kitty);
+    }
+
+    free(words);
+    free(line);
+    if (file != stdin)
+        fclose(file);
+    return rval;
+}
+
 /* Transaction management */
 
 int command_drink(int argc, char** argv, Kitty* kitty)
@@ -221,7 +467,7 @@ int command_drink(int argc, char** argv, Kitty* kitty)
         printf("Usage: %s %s <name> <amount>\n", argv[0], argv[1]);
         return 1;
     }
-    Person *p = get_person_by_name(kitty->persons, argv[2]);
+    Person *p = kitty_find_person(kitty, argv[2]);
     if (!p) {
         printf("Person %s not found\n", argv[2]);
         return 1;
@@ -241,12 +487,10 @@ int command_buy(int argc, char** argv, Kitty* kitty)
 
     int amount = atoi(argv[2]);
     Currency* currency = kitty->settings->currency;
-    CurrencyValue* cost = ftocv(atof(argv[3]), currency);
+    CurrencyValue cost = ftocv(atof(argv[3]), currency);
 
     buy_coffee(kitty, amount, cost);
 
-    currency_value_free(cost);
-
     return 0;
 }
 
@@ -256,19 +500,17 @@ int command_pay(int argc, char** argv, Kitty* kitty)
         printf("Usage: %s %s <name> <amount>\n", argv[0], argv[1]);
         return 1;
     }
-    Person *p = get_person_by_name(kitty->persons, argv[2]);
+    Person *p = kitty_find_person(kitty, argv[2]);
     if (!p) {
         printf("Person %s not found\n", argv[2]);
         return 1;
     }
 
     Currency* currency = kitty->settings->currency;
-    CurrencyValue* payment = ftocv(atof(argv[3]), currency);
+    CurrencyValue payment = ftocv(atof(argv[3]), currency);
 
     person_pays_debt(kitty,p, payment);
 
-    currency_value_free(payment);
-
     return 0;
 }
 
@@ -278,15 +520,15 @@ int command_reimbursement(int argc, char** argv, Kitty* kitty)
         printf("Usage: %s %s <name> <amount>\n", argv[0], argv[1]);
         return 1;
     }
-    Person *p = get_person_by_name(kitty->persons, argv[2]);
+    Person *p = kitty_find_person(kitty, argv[2]);
     if (!p) {
         printf("Person %s not found\n", argv[2]);
         return 1;
     }
 
     Currency* currency = kitty->settings->currency;
-    CurrencyValue* cost = ftocv(atof(argv[3]), currency);
-    
+    CurrencyValue cost = ftocv(atof(argv[3]), currency);
+
     person_buys_misc(kitty, p, cost);
 
     return 0;
@@ -326,12 +568,67 @@ int command_thirst(int argc, char** argv, Kitty* kitty)
         return 1;
     }
 
-    calculate_thirst(kitty->persons);
+    calculate_thirst(&kitty->person_table);
+    kitty->dirty = true;
 
     printf("Thirst calculated. Current coffees reset.\n");
     return 0;
 }
 
+// midnight of a YYYY-MM-DD date in local time
+static int parse_date(const char* date, long* timestamp)
+{
+    struct tm tm = {0};
+    char end;
+    if (sscanf(date, "%d-%d-%d%c", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &end) != 3
+        || tm.tm_mon < 1 || tm.tm_mon > 12 || tm.tm_mday < 1 || tm.tm_mday > 31)
+        return 1;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    struct tm given = tm;
+    time_t t = mktime(&tm);
+    // mktime rolls impossible dates like 2026-02-30 over into the next month
+    if (t == (time_t) -1 || tm.tm_year != given.tm_year
+        || tm.tm_mon != given.tm_mon || tm.tm_mday != given.tm_mday)
+        return 1;
+
+    *timestamp = t;
+    return 0;
+}
+
+int command_history(int argc, char** argv, Kitty* kitty)
+{
+    long since = LONG_MIN;
+    long until = LONG_MAX; // exclusive
+    for (int i = 2; i < argc; i += 2) {
+        long* bound = strcmp(argv[i], "--since") == 0 ? &since
+            : strcmp(argv[i], "--until") == 0 ? &until
+            : NULL;
+        if (!bound || i + 1 >= argc || parse_date(argv[i + 1], bound)) {
+            printf("Usage: %s %s [--since <YYYY-MM-DD>] [--until <YYYY-MM-DD>]\n", argv[0], argv[1]);
+            return 1;
+        }
+    }
+
+    const TimeIndex* index = &kitty->time_index;
+    const TransactionLog* log = &kitty->transactions;
+    size_t first = time_index_lower_bound(index, log, since);
+    size_t last = time_index_lower_bound(index, log, until);
+    for (size_t i = first; i < last; i++) {
+        Transaction* t = &log->items[index->items[i]];
+
+        char date[32];
+        time_t timestamp = t->timestamp;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&timestamp));
+        fprint_transaction(stdout, t, kitty->settings->currency);
+        printf("Time: %s\n", date);
+    }
+
+    return 0;
+}
+
 int command_undo(int argc, char** argv, Kitty* kitty)
 {
     if (argc != 2) {
@@ -339,15 +636,12 @@ int command_undo(int argc, char** argv, Kitty* kitty)
         return 1;
     }
 
-    if (!kitty->transactions) {
+    if (!kitty->transactions.length) {
         printf("No transactions to undo.\n");
         return 1;
     }
-    
-    Transaction* last_transaction;
-    for (last_transaction = kitty->transactions; last_transaction->next; last_transaction = last_transaction->next);
 
-    revert_transaction(kitty, last_transaction);
+    revert_transaction(kitty);
     printf("Last transaction undone.\n");
     return 0;
 }
@@ -366,8 +660,9 @@ int command_add(int argc, char** argv, Kitty* kitty)
     // argc:    1      2       3      4
 
     for (int i=2; i<argc; i++) {
-        Person *new_person = create_person(argv[i], 0, kitty->settings->currency);
-        if (person_add(&kitty->persons, new_person)) {
+        Person *new_person = create_person(kitty->arena, &kitty->person_table, argv[i], 0);
+        if (kitty_add_person(kitty, new_person)) {
+            kitty->dirty = true;
             printf("Sucessfully added person %s\n", new_person->name);
         } else {
             printf("Failed to add person %s\n", new_person->name);
@@ -379,36 +674,50 @@ int command_add(int argc, char** argv, Kitty* kitty)
 
 int command_remove(int argc, char** argv, Kitty* kitty)
 {
-    if (argc < 3) {
-        printf("Usage: %s %s <names>...\n", argv[0], argv[1]);
+    // removed persons are hidden, but stay in the history unless purged
+    bool purge, yes;
+    int first = parse_remove_options(argc, argv, &purge, &yes);
+    if (first < 0 || argc <= first) {
+        printf("Usage: %s %s [--purge] [--yes] <names>...\n", argv[0], argv[1]);
         return 1;
     }
 
-    for (int i=2; i<argc; i++) {
-        Person* person_to_remove = get_person_by_name(kitty->persons, argv[i]);
+    for (int i=first; i<argc; i++) {
+        Person* person_to_remove = purge ? kitty_find_any_person(kitty, argv[i]) : kitty_find_person(kitty, argv[i]);
         if (!person_to_remove) {
-            printf("Person to remove %s not found\n", argv[2]);
+            printf("Person to remove %s not found\n", argv[i]);
             return 1;
         }
 
-        if (person_to_remove->balance->value != 0) {
+        if (kitty->person_table.balance[person_to_remove->row].value != 0) {
             printf("%sPerson %s has a non-zero balance!%s\n", ANSI_RED, person_to_remove->name, ANSI_RESET);
         }
 
-        printf("Are you sure you want to remove %s?\n"
-               "This will remove all transactions related to this person.\n"
-               "THIS ACTION CANNOT BE UNDONE. (y/N): ", person_to_remove->name);
-        char answer = getchar();
-        while (getchar() != '\n'); // clear input buffer
-        if (answer != 'y' && answer != 'Y') {
-            printf("Aborting removal of %s\n", person_to_remove->name);
-            continue;
+        if (!yes) {
+            if (purge) {
+                printf("Are you sure you want to purge %s?\n"
+                       "This will remove all transactions related to this person.\n"
+                       "THIS ACTION CANNOT BE UNDONE. (y/N): ", person_to_remove->name);
+            } else {
+                printf("Are you sure you want to remove %s?\n"
+                       "The transactions of this person are kept, adding %s again brings it back. (y/N): ",
+                       person_to_remove->name, person_to_remove->name);
+            }
+            int answer = getchar();
+            for (int c = answer; c != '\n' && c != EOF; c = getchar()); // clear input buffer
+            if (answer != 'y' && answer != 'Y') {
+                printf("Aborting removal of %s\n", person_to_remove->name);
+                continue;
+            }
         }
 
-        person_remove(&kitty->persons, person_to_remove);
-        clear_transactions_with_target(&kitty->transactions, person_to_remove);
-        printf("Sucessfully removed person %s\n", person_to_remove->name);
-        person_free(person_to_remove);
+        if (purge) {
+            kitty_purge_person(kitty, person_to_remove);
+        } else {
+            kitty_remove_person(kitty, person_to_remove);
+        }
+        kitty->dirty = true;
+        printf("Sucessfully %s person %s\n", purge ? "purged" : "removed", person_to_remove->name);
     }
 
     return 0;
@@ -421,17 +730,19 @@ int command_rename(int argc, char** argv, Kitty* kitty)
         return 1;
     }
 
-    Person* person_to_rename = get_person_by_name(kitty->persons, argv[2]);
+    Person* person_to_rename = kitty_find_person(kitty, argv[2]);
     if (!person_to_rename) {
         printf("Person to rename %s not found\n", argv[2]);
         return 1;
     }
 
-    if (person_rename( kitty->persons, person_to_rename, argv[3]))
+    if (kitty_rename_person(kitty, person_to_rename, argv[3])) {
+        kitty->dirty = true;
         printf("Sucessfully renamed person %s to %s\n", argv[2], argv[3]);
-    else
+    } else {
         printf("Failed to rename person %s to %s\n", argv[2], argv[3]);
-
+        return 1;
+    }
 
     return 0;
 }
\ No newline at end of file
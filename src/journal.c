@@ -0,0 +1,368 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+#include "journal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "kitty.h"
+#include "storage.h"
+#include "person.h"
+#include "currency.h"
+#include "transactions.h"
+#include "operations.h"
+
+/*
+ * Record format, one record per line, fields separated by tabs:
+ *
+ *   T <type> <timestamp> [<delta>...]   transaction
+ *   U <timestamp>                       undo of the last transaction
+ *
+ * where a delta is one of
+ *
+ *   b <value> <id>      balance of a person
+ *   B <value>           balance of the kitty
+ *   p <value>           packs
+ *   c <value> <id>      counter of a person
+ *   C <value>           counter of the kitty
+ */
+
+#define JOURNAL_MAX_FIELDS 64
+
+Journal* journal_alloc(const char *path, long generation)
+{
+    Journal *j = malloc(sizeof(Journal));
+    j->path = malloc(strlen(path) + 1);
+    strcpy(j->path, path);
+    j->generation = generation;
+    j->valid = false;
+    j->end = 0;
+    j->records = 0;
+
+    j->buffer = NULL;
+    j->length = 0;
+    j->capacity = 0;
+    j->pending = 0;
+
+    return j;
+}
+
+void journal_free(Journal *j)
+{
+    free(j->path);
+    free(j->buffer);
+    free(j);
+}
+
+/* recording */
+
+static void journal_reserve(Journal *j, size_t size)
+{
+    if (j->length + size <= j->capacity)
+        return;
+
+    size_t capacity = j->capacity ? j->capacity : 256;
+    while (capacity < j->length + size)
+        capacity *= 2;
+
+    j->buffer = realloc(j->buffer, capacity);
+    j->capacity = capacity;
+}
+
+static void journal_put_field(Journal *j, const char *prefix, long value)
+{
+    journal_reserve(j, 32);
+    j->length += snprintf(j->buffer + j->length, 32, "%s%li", prefix, value);
+}
+
+static void journal_end_record(Journal *j)
+{
+    journal_reserve(j, 1);
+    j->buffer[j->length++] = '\n';
+    j->pending++;
+}
+
+void journal_record_transaction(Journal *j, const Transaction *t)
+{
+    journal_put_field(j, "T\t", t->type);
+    journal_put_field(j, "\t", t->timestamp);
+
+    const Delta *deltas = transaction_deltas(t);
+    for (int i = 0; i < t->delta_count; i++) {
+        const Delta *d = &deltas[i];
+        switch (d->kind) {
+        case BALANCE_DELTA:
+            journal_put_field(j, d->target ? "\tb\t" : "\tB\t", d->value);
+            break;
+        case PACKS_DELTA:
+            journal_put_field(j, "\tp\t", d->value);
+            break;
+        case COUNTER_DELTA:
+            journal_put_field(j, d->target ? "\tc\t" : "\tC\t", d->value);
+            break;
+        }
+        if (d->target)
+            journal_put_field(j, "\t", d->target->id);
+    }
+
+    journal_end_record(j);
+}
+
+void journal_record_undo(Journal *j, long timestamp)
+{
+    journal_put_field(j, "U\t", timestamp);
+    journal_end_record(j);
+}
+
+/* replaying */
+
+typedef struct ReplayState {
+    Kitty *kitty;
+    Person **persons_by_id;
+    int persons_by_id_size;
+} ReplayState;
+
+static int split_fields(char *line, char **fields, int max_fields)
+{
+    int count = 0;
+    char *field = line;
+    while (count < max_fields) {
+        fields[count++] = field;
+        char *tab = strchr(field, '\t');
+        if (!tab)
+            break;
+        *tab = '\0';
+        field = tab + 1;
+    }
+    return count;
+}
+
+static Person* resolve_target(const ReplayState *state, const char *field)
+{
+    int id = atoi(field);
+    return id >= 0 && id < state->persons_by_id_size ? state->persons_by_id[id] : NULL;
+}
+
+static int parse_transaction_record(char **fields, int count, const ReplayState *state, Transaction *t)
+{
+    Kitty *kitty = state->kitty;
+
+    if (count < 3)
+        return 1;
+
+    transaction_init(t, atoi(fields[1]), atol(fields[2]));
+
+    int i = 3;
+    while (i + 1 < count) {
+        char kind = fields[i][0];
+        int value = atoi(fields[i + 1]);
+        Person *target = NULL;
+
+        if (kind == 'b' || kind == 'c') {
+            if (i + 2 >= count)
+                break;
+            target = resolve_target(state, fields[i + 2]);
+            if (!target)
+                break;
+        }
+
+        switch (kind) {
+        case 'b':
+        case 'B':
+            transaction_add_delta(t, kitty->arena, BALANCE_DELTA, value, target);
+            break;
+        case 'p':
+            transaction_add_delta(t, kitty->arena, PACKS_DELTA, value, NULL);
+            break;
+        case 'c':
+        case 'C':
+            transaction_add_delta(t, kitty->arena, COUNTER_DELTA, value, target);
+            break;
+        default:
+            return 1;
+        }
+
+        i += target ? 3 : 2;
+    }
+
+    if (i != count)
+        return 1;
+
+    return 0;
+}
+
+static int replay_record(char *line, const ReplayState *state)
+{
+    char *fields[JOURNAL_MAX_FIELDS];
+    int count = split_fields(line, fields, JOURNAL_MAX_FIELDS);
+
+    if (strcmp(fields[0], "T") == 0) {
+        Transaction t;
+        if (parse_transaction_record(fields, count, state, &t))
+            return 1;
+        replay_transaction(state->kitty, &t);
+        return 0;
+    } else if (strcmp(fields[0], "U") == 0 && count == 2) {
+        return replay_undo(state->kitty);
+    }
+
+    return 1;
+}
+
+static bool header_matches(const char *line, long generation, int *version)
+{
+    char magic[sizeof(KITTY_JOURNAL_MAGIC)];
+    long header_generation;
+
+    if (sscanf(line, "%19s %i %li", magic, version, &header_generation) != 3)
+        return false;
+
+    return strcmp(magic, KITTY_JOURNAL_MAGIC) == 0 && header_generation == generation;
+}
+
+int journal_replay(Journal *j, Kitty *kitty)
+{
+    FILE *file = fopen(j->path, "r");
+    if (!file) {
+        return errno == ENOENT ? 0 : 1;
+    }
+
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t length;
+
+    // A journal from another generation has already been folded into the
+    // snapshot (or belongs to a different one), so it is ignored.
+    length = getline(&line, &size, file);
+    int version;
+    if (length <= 0 || line[length - 1] != '\n' || !header_matches(line, j->generation, &version)) {
+        free(line);
+        fclose(file);
+        return 0;
+    }
+    if (version != KITTY_JOURNAL_VERSION) {
+        fprintf(stderr, "Unsupported journal version %i, this coffeekitty supports %i\n", version, KITTY_JOURNAL_VERSION);
+        free(line);
+        fclose(file);
+        return 1;
+    }
+    j->valid = true;
+    j->end = length;
+
+    ReplayState state = {kitty, NULL, 0};
+    state.persons_by_id = person_id_table(kitty->persons, &state.persons_by_id_size);
+
+    int lineno = 1;
+    while ((length = getline(&line, &size, file)) > 0) {
+        lineno++;
+
+        // an incomplete last line is left over from an interrupted write
+        if (line[length - 1] != '\n')
+            break;
+        line[length - 1] = '\0';
+
+        if (replay_record(line, &state)) {
+            fprintf(stderr, "Ignoring invalid journal record %s:%i\n", j->path, lineno);
+        } else {
+            j->records++;
+        }
+        j->end += length;
+    }
+
+    free(state.persons_by_id);
+    free(line);
+    fclose(file);
+    return 0;
+}
+
+/* writing */
+
+// a new journal file gets the permissions of the database at database_path
+int journal_commit(Journal *j, const char *database_path)
+{
+    if (j->pending == 0)
+        return 0;
+
+    FILE *file;
+    bool created = !j->valid;
+    if (j->valid) {
+        file = fopen(j->path, "r+");
+        if (file && fseek(file, j->end, SEEK_SET)) {
+            fclose(file);
+            file = NULL;
+        }
+    } else {
+        file = fopen(j->path, "w");
+            if (file && copy_permissions(file, database_path)) {
+            fclose(file);
+            file = NULL;
+        }
+        if (file) {
+            int length = fprintf(file, "%s %i %li\n", KITTY_JOURNAL_MAGIC, KITTY_JOURNAL_VERSION, j->generation);
+            j->end = length > 0 ? length : 0;
+        }
+    }
+    if (!file) {
+        fprintf(stderr, "Failed to open journal %s\n", j->path);
+        return 1;
+    }
+
+    // the records are durable once this returns, in a single write and sync
+    bool failed = fwrite(j->buffer, 1, j->length, file) != j->length;
+    failed |= fflush(file) != 0;
+    // drop whatever an interrupted write left behind the last record
+    failed |= ftruncate(fileno(file), j->end + j->length) != 0;
+    failed |= fsync(fileno(file)) != 0;
+    failed |= fclose(file) != 0;
+    // a new journal is lost in a crash until its directory is synced
+    failed |= created && sync_directory(j->path);
+    if (failed) {
+        fprintf(stderr, "Failed to write journal %s\n", j->path);
+        return 1;
+    }
+
+    j->valid = true;
+    j->end += j->length;
+    j->records += j->pending;
+    journal_discard(j);
+    return 0;
+}
+
+void journal_discard(Journal *j)
+{
+    j->length = 0;
+    j->pending = 0;
+}
+
+int journal_reset(Journal *j, long generation)
+{
+    journal_discard(j);
+    j->generation = generation;
+    j->valid = false;
+    j->end = 0;
+    j->records = 0;
+
+    if (remove(j->path) && errno != ENOENT) {
+        fprintf(stderr, "Failed to remove journal %s\n", j->path);
+        return 1;
+    }
+    return 0;
+}
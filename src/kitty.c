@@ -18,31 +18,325 @@
 #include "kitty.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "settings.h"
 #include "currency.h"
 #include "person.h"
 #include "transactions.h"
+#include "person_index.h"
+#include "arena.h"
 
-Kitty *create_kitty(int balance, int price, int packs, int counter, Settings *settings, Person *persons, Transaction *transactions)
+// rebuilds the time index and the transactions of each person from the log
+static void kitty_index_transactions(Kitty *k)
+{
+    time_index_build(&k->time_index, &k->transactions);
+
+    for (Person *p = k->persons; p; p = p->next) {
+        p->transaction_count = 0;
+    }
+
+    for (size_t i = 0; i < k->transactions.length; i++) {
+        const Transaction *t = &k->transactions.items[i];
+        const Delta *deltas = transaction_deltas(t);
+        for (int j = 0; j < t->delta_count; j++) {
+            if (deltas[j].target) {
+                person_add_transaction(deltas[j].target, i);
+            }
+        }
+    }
+}
+
+Kitty *create_kitty(int balance, int price, int packs, int counter, Settings *settings, Person *persons, PersonTable *person_table, TransactionLog *transactions, Arena *arena)
 {
     Kitty *k = malloc(sizeof(Kitty));
+    // the arena the persons were created in
+    k->arena = arena ? arena : create_arena();
 
-    k->balance = currency_value_alloc(balance, settings->currency);
-    k->price = currency_value_alloc(price, settings->currency);
+    k->balance = currency_value(balance);
+    k->price = currency_value(price);
 
     k->counter = counter;
     k->packs = packs;
 
     k->settings = settings;
     k->persons = persons;
-    k->transactions = transactions;
+    // the kitty takes over the table the persons were created with
+    if (person_table) {
+        k->person_table = *person_table;
+    } else {
+        person_table_init(&k->person_table);
+    }
+    k->person_index = person_index_alloc(get_person_count(persons));
+    k->next_person_id = 0;
+    for (Person *p = persons; p; p = p->next) {
+        person_index_insert(k->person_index, p);
+        if (p->id >= k->next_person_id) {
+            k->next_person_id = p->id + 1;
+        }
+    }
+    // persons from databases written before there were ids
+    for (Person *p = persons; p; p = p->next) {
+        if (p->id == PERSON_NO_ID) {
+            p->id = k->next_person_id++;
+        }
+    }
+    // the kitty takes over the transactions
+    if (transactions) {
+        k->transactions = *transactions;
+    } else {
+        transaction_log_init(&k->transactions);
+    }
+    time_index_init(&k->time_index);
+    kitty_index_transactions(k);
+
+    k->storage = NULL;
+    k->generation = 0;
+    k->dirty = false;
+    k->journal = NULL;
     return k;
 }
 
 void kitty_free(Kitty *k)
 {
-    currency_value_free(k->balance);
-    currency_value_free(k->price);
+    for (Person *p = k->persons; p; p = p->next) {
+        person_free_transactions(p);
+    }
+    person_index_free(k->person_index);
+    person_table_free(&k->person_table);
+    time_index_free(&k->time_index);
+    arena_free(k->arena);
     free(k);
-}
\ No newline at end of file
+}
+
+// Moves everything the kitty still refers to into a new arena and frees the
+// old one, with what was left behind: old names of renamed persons, purged
+// persons, persons that failed to be added and deltas of undone transactions.
+// The rows of the person table are packed the same way. Pointers to persons
+// are invalid afterwards.
+void kitty_compact(Kitty *k)
+{
+    Arena *arena = create_arena();
+    PersonTable table;
+    person_table_init(&table);
+
+    int size;
+    Person **persons_by_id = person_id_table(k->persons, &size);
+
+    Person *head = NULL;
+    Person *last = NULL;
+    for (Person *p = k->persons; p; p = p->next) {
+        const PersonTable *old = &k->person_table;
+        int row = p->row;
+        Person *moved = person_create_full(arena, &table, p->name, old->balance[row].value, old->thirst[row],
+            old->current_coffees[row], old->total_coffees[row]);
+        moved->id = p->id;
+        table.removed[moved->row] = old->removed[row];
+        // the index of its transactions stays the same
+        moved->transactions = p->transactions;
+        moved->transaction_count = p->transaction_count;
+        moved->transaction_capacity = p->transaction_capacity;
+
+        if (last) {
+            last->next = moved;
+        } else {
+            head = moved;
+        }
+        last = moved;
+        persons_by_id[p->id] = moved;
+    }
+
+    for (size_t i = 0; i < k->transactions.length; i++) {
+        Transaction *t = &k->transactions.items[i];
+        if (t->delta_capacity > TRANSACTION_INLINE_DELTAS) {
+            Delta *overflow = arena_alloc(arena, t->delta_capacity * sizeof(Delta));
+            memcpy(overflow, t->overflow, t->delta_count * sizeof(Delta));
+            t->overflow = overflow;
+        }
+
+        Delta *deltas = transaction_deltas(t);
+        for (int j = 0; j < t->delta_count; j++) {
+            if (deltas[j].target) {
+                deltas[j].target = persons_by_id[deltas[j].target->id];
+            }
+        }
+    }
+
+    person_index_free(k->person_index);
+    k->person_index = person_index_alloc(get_person_count(head));
+    for (Person *p = head; p; p = p->next) {
+        person_index_insert(k->person_index, p);
+    }
+
+    free(persons_by_id);
+    person_table_free(&k->person_table);
+    k->person_table = table;
+    arena_free(k->arena);
+    k->arena = arena;
+    k->persons = head;
+}
+
+// removed persons are not found
+Person* kitty_find_person(const Kitty *k, const char *name)
+{
+    Person *p = person_index_find(k->person_index, name);
+    return p && !k->person_table.removed[p->row] ? p : NULL;
+}
+
+Person* kitty_find_any_person(const Kitty *k, const char *name)
+{
+    return person_index_find(k->person_index, name);
+}
+
+// Returns NULL if the name is already taken, the person gets the next free
+// id. A removed person of the same name is brought back instead, with its
+// balance and history. The person has to be created with the table of the
+// kitty.
+Person* kitty_add_person(Kitty *k, Person *person)
+{
+    Person *existing = kitty_find_any_person(k, person->name);
+    if (existing) {
+        // the row of the person is not used
+        k->person_table.removed[person->row] = true;
+        if (!k->person_table.removed[existing->row]) {
+            return NULL;
+        }
+        k->person_table.removed[existing->row] = false;
+        return existing;
+    }
+
+    person->id = k->next_person_id++;
+    person_add(&k->persons, person);
+    person_index_insert(k->person_index, person);
+    return person;
+}
+
+// the person stays in the kitty for its transactions, see kitty_purge_person
+void kitty_remove_person(Kitty *k, Person *person)
+{
+    k->person_table.removed[person->row] = true;
+}
+
+// removes the person and all transactions referring to it, the person is not freed
+void kitty_purge_person(Kitty *k, Person *person)
+{
+    kitty_remove_transactions_with_target(k, person);
+    person_index_remove(k->person_index, person);
+    person_remove(&k->persons, person);
+    person_free_transactions(person);
+    k->person_table.removed[person->row] = true;
+}
+
+// returns NULL if the new name is already taken, also by a removed person
+Person* kitty_rename_person(Kitty *k, Person *person, char *new_name)
+{
+    if (kitty_find_any_person(k, new_name)) {
+        return NULL;
+    }
+
+    person_index_remove(k->person_index, person);
+    person_rename(k->arena, person, new_name);
+    person_index_insert(k->person_index, person);
+    return person;
+}
+
+// the log takes over the deltas of t, see transaction_log_push
+Transaction* kitty_push_transaction(Kitty *k, const Transaction *t)
+{
+    size_t index = k->transactions.length;
+    Transaction *pushed = transaction_log_push(&k->transactions, t);
+    time_index_insert(&k->time_index, &k->transactions, index);
+
+    const Delta *deltas = transaction_deltas(pushed);
+    for (int i = 0; i < pushed->delta_count; i++) {
+        if (deltas[i].target) {
+            person_add_transaction(deltas[i].target, index);
+        }
+    }
+    return pushed;
+}
+
+// moves the last transaction to t, returns false if there is none
+bool kitty_pop_transaction(Kitty *k, Transaction *t)
+{
+    if (!k->transactions.length) {
+        return false;
+    }
+
+    time_index_remove(&k->time_index, &k->transactions, k->transactions.length - 1);
+    transaction_log_pop(&k->transactions, t);
+
+    const Delta *deltas = transaction_deltas(t);
+    for (int i = 0; i < t->delta_count; i++) {
+        if (deltas[i].target) {
+            person_remove_transaction(deltas[i].target, k->transactions.length);
+        }
+    }
+    return true;
+}
+
+// number of transactions of the person before index, which is where index
+// would be in its ascending transactions
+static size_t person_transactions_before(const Person *person, size_t index)
+{
+    size_t low = 0;
+    size_t high = person->transaction_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (person->transactions[middle] < index)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// Filters the log in a single pass, starting at the first transaction of the
+// person. Only the transactions behind that one move, so only their indices
+// are shifted down by the number of removed transactions before them.
+void kitty_remove_transactions_with_target(Kitty *k, Person *person)
+{
+    if (!person->transaction_count) {
+        return;
+    }
+
+    TransactionLog *log = &k->transactions;
+    size_t first = person->transactions[0];
+    size_t kept = first;
+    size_t next = 0;
+    for (size_t i = first; i < log->length; i++) {
+        if (next < person->transaction_count && person->transactions[next] == i) {
+            next++;
+        } else {
+            log->items[kept++] = log->items[i];
+        }
+    }
+    log->length = kept;
+
+    for (Person *p = k->persons; p; p = p->next) {
+        if (p == person) {
+            continue;
+        }
+        for (size_t j = person_transactions_before(p, first); j < p->transaction_count; j++) {
+            p->transactions[j] -= person_transactions_before(person, p->transactions[j]);
+        }
+    }
+
+    // the order by time is kept, the removed transactions only drop out
+    TimeIndex *index = &k->time_index;
+    size_t length = 0;
+    for (size_t i = 0; i < index->length; i++) {
+        size_t position = index->items[i];
+        if (position >= first) {
+            size_t before = person_transactions_before(person, position);
+            if (before < person->transaction_count && person->transactions[before] == position) {
+                continue;
+            }
+            position -= before;
+        }
+        index->items[length++] = position;
+    }
+    index->length = length;
+
+    person->transaction_count = 0;
+}
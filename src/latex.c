@@ -60,9 +60,9 @@ const int ARRAY_RULE_WIDTH_IN_HPT = 1;
 void fprint_latex_kitty_properties(FILE* file, const Kitty *kitty, const char* prefix)
 {
     fprintf(file, "%s\\begin{tabular}{l  l  l}\n", prefix);
-    fprintf(file, "%s%sTotal Balance: & %s & + %i Packs\\\\\n", prefix, T1, currency_value_format(kitty->balance, false, true), kitty->packs);
+    fprintf(file, "%s%sTotal Balance: & %s & + %i Packs\\\\\n", prefix, T1, currency_value_format(kitty->balance, kitty->settings->currency, false, true), kitty->packs);
     fprintf(file, "%s%sCounter: & %d & \\\\\n", prefix, T1, kitty->counter);
-    fprintf(file, "%s%sPrice: & %s/Coffee & \\\\\n", prefix, T1, currency_value_format(kitty->price, false, true));
+    fprintf(file, "%s%sPrice: & %s/Coffee & \\\\\n", prefix, T1, currency_value_format(kitty->price, kitty->settings->currency, false, true));
 
     time_t now = time(NULL);
     struct tm *tm = localtime(&now);
@@ -77,14 +77,19 @@ void fprint_latex_tallytabular(FILE* file, const Kitty *kitty, bool skeleton, co
     fprintf(file, "%s\t\\textbf{Name} & \\textbf{Balance}/%s & & \\textbf{Expenses} \\\\\n", prefix, kitty->settings->currency->isoname);
     fprintf(file, "%s\t\\hline\n", prefix);
 
+    const PersonTable *table = &kitty->person_table;
     for (Person* p = kitty->persons; p != NULL; p = p->next) {
+        if (table->removed[p->row]) {
+            continue;
+        }
         fprintf(file, "%s\t\\hline\n", prefix);
 
+        CurrencyValue balance = table->balance[p->row];
         char balance_color_modifier[128] = "{";
         char balance_boldness_modifier[128] = "{";
-        if (p->balance->value < 0) {
+        if (balance.value < 0) {
             snprintf(balance_color_modifier, sizeof(balance_color_modifier), "\\textcolor{red}{");
-            if (p->balance->value < -10000) {
+            if (balance.value < -10000) {
                 snprintf(balance_boldness_modifier, sizeof(balance_boldness_modifier), "\\textbf{");
             }
         }
@@ -92,12 +97,12 @@ void fprint_latex_tallytabular(FILE* file, const Kitty *kitty, bool skeleton, co
         fprintf(file, "%s%s & %s%s%s%s%s &  &  \\\\",
             T3, p->name,
             balance_color_modifier, balance_boldness_modifier,
-            currency_value_format(p->balance, false, false),
+            currency_value_format(balance, kitty->settings->currency, false, false),
             "}","}"
             );
         if (!skeleton)
             fprintf(file, "[%f\\distributablespace]",
-                p->thirst);
+                table->thirst[p->row]);
         fprintf(file, "\n");
     }
     fprintf(file, "%s\t\\hline\n%s\\end{tabularx}\n", prefix, prefix);
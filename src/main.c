@@ -17,73 +17,152 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 #include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "currency.h"
 #include "kitty.h"
 #include "storage.h"
 #include "commands.h"
 #include "transactions.h"
+#include "backend.h"
+#include "protocol.h"
+#include "operations.h"
 
 void clean_exit(int rval, Kitty* kitty, bool save)
 {
-    if (save) {
-        sort_persons_by_name(&kitty->persons);
-        if (save_kitty_to_xml(get_config_file_path(), kitty)) {
+    if (save && kitty) {
+        if (save_kitty(kitty)) {
             fprintf(stderr, "Failed to save database\n");
             rval = 1;
         }
     }
 
     if (kitty) {
-        if (kitty->persons) {
-            persons_free(kitty->persons);
-        }
-        if (kitty->settings) {
-            if (kitty->settings->currency) {
-                currency_free(kitty->settings->currency);
-            }
-            settings_free(kitty->settings);
-        }
-        if (kitty->transactions) {
-            transactions_free(kitty->transactions);
-        }
-        kitty_free(kitty);
+        unload_kitty(kitty);
     }
 
     exit(rval);
 }
 
+// Takes the exclusive lock for saving a kitty that was loaded under a shared
+// one. If someone else saved the database in the meantime, it is loaded
+// again and the new transactions, from index first on, are moved onto it.
+static Kitty* relock_kitty(Kitty* kitty, const DatabaseStamp* stamp, size_t first)
+{
+    if (lock_database(true, KITTY_LOCK_TIMEOUT_MS) < 0) {
+        unload_kitty(kitty);
+        return NULL;
+    }
+    if (!database_changed(stamp)) {
+        return kitty;
+    }
+
+    Kitty* current = load_kitty();
+    if (current && rebase_transactions(current, kitty, first)) {
+        unload_kitty(current);
+        current = NULL;
+    }
+    if (!current) {
+        fprintf(stderr, "Failed to apply the changes to the database changed meanwhile, nothing was saved\n");
+    }
+
+    unload_kitty(kitty);
+    return current;
+}
+
 int main(int argc, char **argv)
 {
-    const char* filepath = get_config_file_path();
-
-    if (access(filepath, F_OK)) {
-        fprintf(stderr, "Creating database...\n");
-
-        Settings *settings = settings_alloc(currency_alloc("EUR", false, 2, '.'));
-        Person *persons = NULL;
-        Transaction* transactions = NULL;
-        Kitty *kitty = create_kitty(0, 25, 0, 0, settings, persons, transactions);
-        if (mkdir_p(get_config_directory())) {
-            fprintf(stderr, "Failed to create directory\n");
-            clean_exit(1, kitty, false);
+    // options before the operation, which becomes argv[1]
+    bool optimistic = false; // appending commands do not keep the database locked while they run
+    const char* name = "";
+    int i = 1;
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "--optimistic") == 0) {
+            optimistic = true;
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else {
+            break;
         }
-        if (save_kitty_to_xml(filepath, kitty)) {
-            fprintf(stderr, "Failed to save database\n");
-            clean_exit(1, kitty, false);
+    }
+    argv[i - 1] = argv[0];
+    argv += i - 1;
+    argc -= i - 1;
+
+    if (select_kitty(name)) {
+        fprintf(stderr, "Invalid kitty name %s, use up to %i letters, digits, ., _ and -\n", name, KITTY_NAME_MAX);
+        return 1;
+    }
+
+    const Command* command = find_command(argc, argv);
+    if (!command) {
+        printf("Command %s not found.\n Try %s help\n", argv[1], argv[0]);
+        return 1;
+    }
+
+    // e.g. help, never touches the database
+    if (command->access == COMMAND_NO_KITTY) {
+        return command->function(argc, argv, NULL);
+    }
+
+    // a running coffeekittyd owns the database
+    int daemon = connect_daemon();
+    if (daemon >= 0) {
+        // it can not wait for an answer, so the question is asked up front
+        static char yes[] = "--yes";
+        char* confirmed_argv[argc + 2];
+        if (command_asks(argc, argv)) {
+            if (!confirm_command(argc, argv)) {
+                close(daemon);
+                return 0;
+            }
+            confirmed_argv[0] = argv[0];
+            confirmed_argv[1] = argv[1];
+            confirmed_argv[2] = yes;
+            memcpy(confirmed_argv + 3, argv + 2, (argc - 2) * sizeof(char*));
+            confirmed_argv[argc + 1] = NULL;
+            argv = confirmed_argv;
+            argc++;
         }
+        return forward_command(daemon, argc, argv);
     }
 
-    Kitty *kitty = load_kitty_from_xml(get_config_file_path());
+    int rval;
+
+    // held until exit, so nobody saves in between loading and saving
+    bool writes = command->access >= COMMAND_APPENDS;
+    optimistic &= command->access == COMMAND_APPENDS;
+    int lock = lock_database(writes && !optimistic, KITTY_LOCK_TIMEOUT_MS);
+    if (lock < 0) {
+        return 1;
+    }
+
+    if (!database_exists() && create_database()) {
+        return 1;
+    }
+
+    DatabaseStamp stamp;
+    database_stamp(&stamp);
+    Kitty *kitty = load_kitty();
 
     if (!kitty) {
         return 1;
     }
 
-    int rval;
-    rval = parse_command(argc, argv, kitty);
+    if (optimistic) {
+        unlock_database(lock);
+        size_t first = kitty->transactions.length;
+        rval = command->function(argc, argv, kitty);
+        kitty = relock_kitty(kitty, &stamp, first);
+        if (!kitty) {
+            return 1;
+        }
+    } else {
+        rval = command->function(argc, argv, kitty);
+    }
 
-    clean_exit(rval, kitty, true);
+    // read-only commands leave the database untouched
+    clean_exit(rval, kitty, writes);
 }
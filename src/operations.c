@@ -24,107 +24,213 @@
 #include "currency.h"
 #include "kitty.h"
 #include "transactions.h"
+#include "backend.h"
 
-void person_pays_debt(Kitty* kitty, Person* person, CurrencyValue* payment)
+static void record_transaction(Kitty* kitty, Transaction* t)
 {
-    Transaction* t = transaction_alloc(PERSON_PAYS_DEBT, -1);
-    balance_delta_add(&t->balance_delta_head, balance_delta_alloc(currency_value_copy(payment), person));
-    balance_delta_add(&t->balance_delta_head, balance_delta_alloc(currency_value_copy(payment), NULL));
-
     apply_transaction(kitty, t);
-    transaction_add(&kitty->transactions, t);
+    Transaction* recorded = kitty_push_transaction(kitty, t);
+
+    if (kitty->storage)
+        kitty->storage->append(kitty, recorded);
 }
 
-void person_buys_misc(Kitty* kitty, Person* person, CurrencyValue* cost)
+void person_pays_debt(Kitty* kitty, Person* person, CurrencyValue payment)
 {
-    Transaction* t = transaction_alloc(PERSON_BUYS_MISC, -1);
-    balance_delta_add(&t->balance_delta_head, balance_delta_alloc(currency_value_copy(cost), person));
+    Transaction t;
+    transaction_init(&t, PERSON_PAYS_DEBT, -1);
+    transaction_add_delta(&t, kitty->arena, BALANCE_DELTA, payment.value, person);
+    transaction_add_delta(&t, kitty->arena, BALANCE_DELTA, payment.value, NULL);
 
-    apply_transaction(kitty, t);
-    transaction_add(&kitty->transactions, t);
+    record_transaction(kitty, &t);
 }
 
-void person_drinks_coffee(Kitty* kitty, Person* person, int amount)
+void person_buys_misc(Kitty* kitty, Person* person, CurrencyValue cost)
 {
-    Transaction* t = transaction_alloc(PERSON_DRINKS_COFFEE, -1);
+    Transaction t;
+    transaction_init(&t, PERSON_BUYS_MISC, -1);
+    transaction_add_delta(&t, kitty->arena, BALANCE_DELTA, cost.value, person);
 
-    CounterDelta* cd_p = counter_delta_alloc(amount, person);    
-    CounterDelta* cd_k = counter_delta_alloc(amount, NULL);    
-    counter_delta_add(&t->counter_delta_head, cd_p);
-    counter_delta_add(&t->counter_delta_head, cd_k);
+    record_transaction(kitty, &t);
+}
 
-    CurrencyValue* delta_cv = currency_value_new_negative(kitty->price);
-    currency_value_mul(delta_cv, amount);
-    balance_delta_add(&t->balance_delta_head, balance_delta_alloc(delta_cv, person));
+void person_drinks_coffee(Kitty* kitty, Person* person, int amount)
+{
+    Transaction t;
+    transaction_init(&t, PERSON_DRINKS_COFFEE, -1);
 
-    apply_transaction(kitty, t);
-    transaction_add(&kitty->transactions, t);
+    transaction_add_delta(&t, kitty->arena, COUNTER_DELTA, amount, person);
+    transaction_add_delta(&t, kitty->arena, COUNTER_DELTA, amount, NULL);
+    transaction_add_delta(&t, kitty->arena, BALANCE_DELTA, currency_value_mul(currency_value_negative(kitty->price), amount).value, person);
+
+    record_transaction(kitty, &t);
 }
 
-void buy_coffee(Kitty* kitty, int amount, CurrencyValue* cost)
+void buy_coffee(Kitty* kitty, int amount, CurrencyValue cost)
 {
-    Transaction* t = transaction_alloc(KITTY_BUY_COFFEE, -1);
-    PacksDelta* pd = packs_delta_alloc(amount);
-    packs_delta_add(&t->packs_delta_head, pd);
+    Transaction t;
+    transaction_init(&t, KITTY_BUY_COFFEE, -1);
+    transaction_add_delta(&t, kitty->arena, PACKS_DELTA, amount, NULL);
+    transaction_add_delta(&t, kitty->arena, BALANCE_DELTA, -cost.value, NULL);
 
-    CurrencyValue* delta_cv = currency_value_new_negative(cost);
-    balance_delta_add(&t->balance_delta_head, balance_delta_alloc(delta_cv, NULL));
-
-    apply_transaction(kitty, t);
-    transaction_add(&kitty->transactions, t);
+    record_transaction(kitty, &t);
 }
 
-void calculate_thirst(Person* persons)
+// Removed persons are left out, they get no thirst but keep their current
+// coffees. The loops are written without branches, so they can be vectorized.
+void calculate_thirst(PersonTable* table)
 {
+    int rows = table->rows;
+    const unsigned char* restrict removed = table->removed;
+    int* restrict current_coffees = table->current_coffees;
+    float* restrict thirst = table->thirst;
+
     int current_total_coffees = 0;
-    for (Person* p = persons; p; p = p->next)
-        current_total_coffees += p->current_coffees;
+    for (int i = 0; i < rows; i++)
+        current_total_coffees += current_coffees[i] * (removed[i] == 0);
 
     if (current_total_coffees != 0) {
-        for (Person* p = persons; p; p = p->next) {
-            p->thirst = (float) p->current_coffees / current_total_coffees;
-            p->current_coffees = 0;
+        for (int i = 0; i < rows; i++) {
+            int current = current_coffees[i];
+            int live = removed[i] == 0;
+            thirst[i] = (float) (current * live) / current_total_coffees;
+            current_coffees[i] = current * !live;
         }
     }
 }
 
 void consume_pack(Kitty* kitty)
 {
-    Transaction* t = transaction_alloc(KITTY_CONSUME_PACK, -1);
-    PacksDelta* pd = packs_delta_alloc(-1);
-    packs_delta_add(&t->packs_delta_head, pd);
+    Transaction t;
+    transaction_init(&t, KITTY_CONSUME_PACK, -1);
+    transaction_add_delta(&t, kitty->arena, PACKS_DELTA, -1, NULL);
 
-    apply_transaction(kitty, t);
-    transaction_add(&kitty->transactions, t);
+    record_transaction(kitty, &t);
+}
+
+static void apply_deltas(Kitty* k, Transaction* t)
+{
+    const Delta* deltas = transaction_deltas(t);
+    for (int i = 0; i < t->delta_count; i++) {
+        const Delta* d = &deltas[i];
+        switch (d->kind) {
+        case BALANCE_DELTA:
+            if (d->target) {
+                k->person_table.balance[d->target->row].value += d->value;
+            } else { // target is NULL ⇒ apply to kitty
+                k->balance.value += d->value;
+            }
+            break;
+        case PACKS_DELTA:
+            k->packs += d->value;
+            break;
+        case COUNTER_DELTA:
+            if (d->target) {
+                k->person_table.current_coffees[d->target->row] += d->value;
+                k->person_table.total_coffees[d->target->row] += d->value;
+            } else { // target is NULL ⇒ apply to kitty
+                k->counter += d->value;
+            }
+            break;
+        }
+    }
 }
 
 void apply_transaction(Kitty* k, Transaction* t){
-    fprint_transaction(stdout, t);
+    fprint_transaction(stdout, t, k->settings->currency);
+    apply_deltas(k, t);
+}
+
+void revert_transaction(Kitty* k)
+{
+    Transaction last;
+    if (!kitty_pop_transaction(k, &last))
+        return;
+
+    Transaction inverted;
+    transaction_invert(&last, &inverted, k->arena);
+    apply_transaction(k, &inverted);
 
-    for(BalanceDelta* bd = t->balance_delta_head; bd; bd = bd->next) {
-        if (bd->target) {
-            currency_value_add(bd->target->balance, bd->cv);
-        } else { // target is NULL ⇒ apply to kitty
-            currency_value_add(k->balance, bd->cv);
+    if (k->storage)
+        k->storage->undo(k);
+}
+
+/* replaying, e.g. from the journal, does not print anything */
+
+void replay_transaction(Kitty* k, Transaction* t)
+{
+    apply_deltas(k, t);
+    kitty_push_transaction(k, t);
+}
+
+int replay_undo(Kitty* k)
+{
+    Transaction last;
+    if (!kitty_pop_transaction(k, &last))
+        return 1;
+
+    Transaction inverted;
+    transaction_invert(&last, &inverted, k->arena);
+    apply_deltas(k, &inverted);
+    return 0;
+}
+
+/* rebasing moves new transactions onto a kitty saved by someone else in the
+ * meantime, they are printed already */
+
+static Person* rebase_target(const Kitty* k, Person** persons_by_id, int size, const Person* target)
+{
+    if (target->id < 0 || target->id >= size)
+        return NULL;
+
+    Person* p = persons_by_id[target->id];
+    return p && !k->person_table.removed[p->row] ? p : NULL;
+}
+
+// The transactions of stale from index first on are calculated with its
+// price and persons, so rebasing fails without changing k if the price
+// differs, a person is gone or a pack would be consumed twice.
+int rebase_transactions(Kitty* k, const Kitty* stale, size_t first)
+{
+    if (k->price.value != stale->price.value)
+        return 1;
+
+    int size;
+    Person** persons_by_id = person_id_table(k->persons, &size);
+
+    int packs = k->packs;
+    for (size_t i = first; i < stale->transactions.length; i++) {
+        const Transaction* t = &stale->transactions.items[i];
+        const Delta* deltas = transaction_deltas(t);
+        for (int j = 0; j < t->delta_count; j++) {
+            const Delta* d = &deltas[j];
+            if (d->kind == PACKS_DELTA)
+                packs += d->value;
+            if ((d->target && !rebase_target(k, persons_by_id, size, d->target)) || packs < 0) {
+                free(persons_by_id);
+                return 1;
+            }
         }
     }
-    for (PacksDelta* pd = t->packs_delta_head; pd; pd = pd->next) {
-        k->packs += pd->packs;
-    }
-    for (CounterDelta* cd = t->counter_delta_head; cd; cd = cd->next) {
-        if (cd->target) {
-            cd->target->current_coffees += cd->counter;
-            cd->target->total_coffees += cd->counter;
-        } else { // target is NULL ⇒ apply to kitty
-            k->counter += cd->counter;
+
+    for (size_t i = first; i < stale->transactions.length; i++) {
+        const Transaction* s = &stale->transactions.items[i];
+        const Delta* deltas = transaction_deltas(s);
+
+        Transaction t;
+        transaction_init(&t, s->type, s->timestamp);
+        for (int j = 0; j < s->delta_count; j++) {
+            const Delta* d = &deltas[j];
+            Person* target = d->target ? rebase_target(k, persons_by_id, size, d->target) : NULL;
+            transaction_add_delta(&t, k->arena, d->kind, d->value, target);
         }
-    }
-}
 
-void revert_transaction(Kitty* k, Transaction* t)
-{
-    Transaction* inverted_t = transaction_invert(t);
-    apply_transaction(k, inverted_t);
+        apply_deltas(k, &t);
+        Transaction* recorded = kitty_push_transaction(k, &t);
+        if (k->storage)
+            k->storage->append(k, recorded);
+    }
 
-    transaction_free(transaction_pop(&k->transactions));
+    free(persons_by_id);
+    return 0;
 }
\ No newline at end of file
@@ -26,23 +26,25 @@
 #include "currency.h"
 #include "transactions.h"
 
-void fprint_person(FILE* file, Person *p)
+void fprint_person(FILE* file, const Kitty *kitty, const Person *p)
 {
+    const PersonTable *table = &kitty->person_table;
     fprintf(file, "Name: %s\n", p->name);
-    fprintf(file,"Balance: %s\n", currency_value_format(p->balance, true, true));
+    fprintf(file,"Balance: %s\n", currency_value_format(table->balance[p->row], kitty->settings->currency, true, true));
     fprintf(file, "\n");
-    fprintf(file,"Thirst: %f\n", p->thirst);
-    fprintf(file,"Current coffees: %i\n", p->current_coffees);
-    fprintf(file,"Total: %i\n", p->total_coffees);
+    fprintf(file,"Thirst: %f\n", table->thirst[p->row]);
+    fprintf(file,"Current coffees: %i\n", table->current_coffees[p->row]);
+    fprintf(file,"Total: %i\n", table->total_coffees[p->row]);
 }
 
-void print_persons(Person *head)
+void print_persons(const Kitty *kitty)
 {
-    Person *p = head;
-    while (p) {
+    for (Person *p = kitty->persons; p; p = p->next) {
+        if (kitty->person_table.removed[p->row]) {
+            continue;
+        }
         printf("\n");
-        fprint_person(stdout, p);
-        p = p->next;
+        fprint_person(stdout, kitty, p);
         printf("\n");
     }
 }
@@ -50,10 +52,12 @@ void print_persons(Person *head)
 void fprint_kitty(FILE* file, Kitty *kitty)
 {
     fprintf(file, ANSI_YELLOW "+++ Kitty +++\n" ANSI_RESET);
-    fprintf(file, "Balance: %s\n", currency_value_format(kitty->balance, true, true));
-    fprintf(file, "Price: %s\n", currency_value_format(kitty->price, false, true));
+    fprintf(file, "Balance: %s\n", currency_value_format(kitty->balance, kitty->settings->currency, true, true));
+    fprintf(file, "Price: %s\n", currency_value_format(kitty->price, kitty->settings->currency, false, true));
     fprintf(file, "Packs: %i\n", kitty->packs);
     fprintf(file, "Counter: %i\n", kitty->counter);
+    fprintf(file, "Debts: %s\n", currency_value_format(person_table_debts(&kitty->person_table), kitty->settings->currency, true, true));
+    fprintf(file, "Credits: %s\n", currency_value_format(person_table_credits(&kitty->person_table), kitty->settings->currency, true, true));
 }
 
 void fprint_hline(FILE* file, int width)
@@ -64,7 +68,7 @@ void fprint_hline(FILE* file, int width)
     fprintf(file, "\n");
 }
 
-void fprint_transaction(FILE* file, Transaction* transaction){
+void fprint_transaction(FILE* file, Transaction* transaction, Currency* currency){
     fprintf(file, ANSI_YELLOW "+++ Transaction +++\n" ANSI_RESET);
 
     fprintf(file, "Type: ");
@@ -93,39 +97,53 @@ void fprint_transaction(FILE* file, Transaction* transaction){
     }
 
     fprintf(file, "Changes: \n");
-    if (transaction->balance_delta_head)
+    const Delta* deltas = transaction_deltas(transaction);
+
+    if (transaction_has_deltas(transaction, BALANCE_DELTA))
         fprintf(file, "-> Balance: \n");
-    for (BalanceDelta* bd = transaction->balance_delta_head; bd; bd = bd->next) {
-        if (bd->target)
-            fprintf(file, "   Balance of %s is modified by ", bd->target->name);
+    for (int i = 0; i < transaction->delta_count; i++) {
+        const Delta* d = &deltas[i];
+        if (d->kind != BALANCE_DELTA)
+            continue;
+
+        if (d->target)
+            fprintf(file, "   Balance of %s is modified by ", d->target->name);
         else
             fprintf(file, "   Kitty balance is modified by ");
 
-        fprintf(file, "%s\n", currency_value_format(bd->cv, true, true));
+        fprintf(file, "%s\n", currency_value_format(currency_value(d->value), currency, true, true));
     }
 
-    if (transaction->packs_delta_head)
+    if (transaction_has_deltas(transaction, PACKS_DELTA))
         fprintf(file, "-> Packs: \n");
     char verb[6] = {0};
-    for (PacksDelta* pd = transaction->packs_delta_head; pd; pd = pd->next) {
-        if (pd->packs > 0)
-            fprintf(file, "   Kitty gets %i packs\n", pd->packs);
-        else if (pd->packs < 0)
-            fprintf(file, "   Kitty loses %i packs\n", -pd->packs);
+    for (int i = 0; i < transaction->delta_count; i++) {
+        const Delta* d = &deltas[i];
+        if (d->kind != PACKS_DELTA)
+            continue;
+
+        if (d->value > 0)
+            fprintf(file, "   Kitty gets %i packs\n", d->value);
+        else if (d->value < 0)
+            fprintf(file, "   Kitty loses %i packs\n", -d->value);
     }
 
-    if (transaction->counter_delta_head)
+    if (transaction_has_deltas(transaction, COUNTER_DELTA))
         fprintf(file, "-> Counters: \n");
-    for (CounterDelta* cd = transaction->counter_delta_head; cd; cd = cd->next) {
-        if (cd->counter >= 0)
+    for (int i = 0; i < transaction->delta_count; i++) {
+        const Delta* d = &deltas[i];
+        if (d->kind != COUNTER_DELTA)
+            continue;
+
+        if (d->value >= 0)
             strcpy(verb, "gets");
-        else if (cd->counter < 0)
+        else if (d->value < 0)
             strcpy(verb, "loses");
 
-        if (cd->target)
-            fprintf(file, "   %s %s %i coffees\n", cd->target->name, verb, cd->counter);
+        if (d->target)
+            fprintf(file, "   %s %s %i coffees\n", d->target->name, verb, d->value);
         else
-            fprintf(file, "   Total %s %i coffees\n", verb, cd->counter);
+            fprintf(file, "   Total %s %i coffees\n", verb, d->value);
     }
 }
 
@@ -153,12 +171,16 @@ void fprint_output(FILE* file, Kitty* kitty)
     int current_counter_width = strlen("Counter");
     int total_counter_width = strlen("Total");
     int thirst_width = strlen("Thirst");
+    const PersonTable *table = &kitty->person_table;
     for (Person* p = kitty->persons; p; p = p->next) {
+        if (table->removed[p->row]) {
+            continue;
+        }
         int this_name_width = utf8_strlen(p->name);
-        int this_balance_width = strlen(currency_value_format(p->balance, false, true));
-        int this_current_counter_width = snprintf(NULL, 0, "%i", p->current_coffees);
-        int this_total_counter_width = snprintf(NULL, 0, "%i", p->total_coffees);
-        int this_thirst_width = snprintf(NULL, 0, "%f", p->thirst);
+        int this_balance_width = strlen(currency_value_format(table->balance[p->row], kitty->settings->currency, false, true));
+        int this_current_counter_width = snprintf(NULL, 0, "%i", table->current_coffees[p->row]);
+        int this_total_counter_width = snprintf(NULL, 0, "%i", table->total_coffees[p->row]);
+        int this_thirst_width = snprintf(NULL, 0, "%f", table->thirst[p->row]);
         name_width = this_name_width > name_width ? this_name_width : name_width;
         balance_width = this_balance_width > balance_width ? this_balance_width : balance_width;
         current_counter_width = this_current_counter_width > current_counter_width ? this_current_counter_width : current_counter_width;
@@ -174,14 +196,18 @@ void fprint_output(FILE* file, Kitty* kitty)
     fprintf(file, "%-*s | %-*s | %-*s / %-*s | %-*s\n", name_width, "Name", balance_width, "Balance", current_counter_width, "Counter", total_counter_width, "Total", thirst_width, "Thirst");
     fprint_hline(file, total_width);
     for (Person* p = kitty->persons; p; p = p->next) {
+        if (table->removed[p->row]) {
+            continue;
+        }
+        CurrencyValue balance = table->balance[p->row];
         fprintf(file, "%-*s | %s%*s%s | %*i / %*i | %-*f\n",
             name_width + excess_bytes(p->name), p->name,
-            currency_value_format_color_prefix(p->balance),
-            balance_width, currency_value_format(p->balance, false, true),
-            currency_value_format_color_suffix(p->balance),
-            current_counter_width, p->current_coffees,
-            total_counter_width, p->total_coffees, 
-            thirst_width, p->thirst);
+            currency_value_format_color_prefix(balance),
+            balance_width, currency_value_format(balance, kitty->settings->currency, false, true),
+            currency_value_format_color_suffix(balance),
+            current_counter_width, table->current_coffees[p->row],
+            total_counter_width, table->total_coffees[p->row], 
+            thirst_width, table->thirst[p->row]);
     }
 }
 
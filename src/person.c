@@ -20,66 +20,111 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 #include "currency.h"
+#include "arena.h"
 
-Person* person_create_full(char* name, int balance, Currency* currency, float thirst, int current_coffees, int total_coffees)
-{
-    Person* p = malloc(sizeof(Person));
-    p->name_length = strlen(name);
-    p->name = malloc(p->name_length + 1);
-    strcpy(p->name, name);
-
-    p->balance = currency_value_alloc(balance, currency);
-
-    p->thirst = thirst;
-    p->current_coffees = current_coffees;
-    p->total_coffees = total_coffees;
+/* table */
 
-    p->next = NULL;
-    
-    return p;
+void person_table_init(PersonTable *table)
+{
+    table->balance = NULL;
+    table->thirst = NULL;
+    table->current_coffees = NULL;
+    table->total_coffees = NULL;
+    table->removed = NULL;
+    table->rows = 0;
+    table->capacity = 0;
 }
 
-Person* create_person(char* name, int balance, Currency* currency)
+void person_table_free(PersonTable *table)
 {
-    return person_create_full(name, balance, currency, 0., 0, 0);
+    free(table->balance);
+    free(table->thirst);
+    free(table->current_coffees);
+    free(table->total_coffees);
+    free(table->removed);
+    person_table_init(table);
 }
 
-void person_free(Person *p)
+int person_table_add_row(PersonTable *table, int balance, float thirst, int current_coffees, int total_coffees)
 {
-    free(p->name);
-    currency_value_free(p->balance);
+    if (table->rows == table->capacity) {
+        table->capacity = table->capacity ? 2 * table->capacity : 16;
+        table->balance = realloc(table->balance, sizeof(CurrencyValue) * table->capacity);
+        table->thirst = realloc(table->thirst, sizeof(float) * table->capacity);
+        table->current_coffees = realloc(table->current_coffees, sizeof(int) * table->capacity);
+        table->total_coffees = realloc(table->total_coffees, sizeof(int) * table->capacity);
+        table->removed = realloc(table->removed, table->capacity);
+    }
 
-    free(p);
+    int row = table->rows++;
+    table->balance[row] = currency_value(balance);
+    table->thirst[row] = thirst;
+    table->current_coffees[row] = current_coffees;
+    table->total_coffees[row] = total_coffees;
+    table->removed[row] = false;
+    return row;
 }
 
-void persons_free(Person *persons)
+// sum of the negative balances of the persons that are not removed
+CurrencyValue person_table_debts(const PersonTable *table)
 {
-    Person *p = persons;
-    while (p) {
-        Person *next = p->next;
-        person_free(p);
-        p = next;
+    const CurrencyValue *balance = table->balance;
+    const unsigned char *removed = table->removed;
+    int debts = 0;
+    for (int i = 0; i < table->rows; i++) {
+        int value = balance[i].value * (removed[i] == 0);
+        debts += value < 0 ? value : 0;
     }
+    return currency_value(debts);
 }
 
-Person* person_add(Person **head, Person *person)
+// sum of the positive balances of the persons that are not removed
+CurrencyValue person_table_credits(const PersonTable *table)
 {
-    if (get_person_by_name(*head, person->name) != NULL) {
-        return NULL;
+    const CurrencyValue *balance = table->balance;
+    const unsigned char *removed = table->removed;
+    int credits = 0;
+    for (int i = 0; i < table->rows; i++) {
+        int value = balance[i].value * (removed[i] == 0);
+        credits += value > 0 ? value : 0;
     }
+    return currency_value(credits);
+}
 
-    // find end
-    Person* end;
-    for (end = *head; end && end->next; end = end->next);
+/* persons */
 
-    if (end == NULL) {
-        *head = person;
-    } else {
-        end->next = person;
-    }
+// persons live as long as the arena, their numbers as long as the table
+Person* person_create_full(Arena* arena, PersonTable* table, char* name, int balance, float thirst, int current_coffees, int total_coffees)
+{
+    Person* p = arena_alloc(arena, sizeof(Person));
+    p->id = PERSON_NO_ID;
+    p->row = person_table_add_row(table, balance, thirst, current_coffees, total_coffees);
+    p->name_length = strlen(name);
+    p->name = arena_strdup(arena, name);
 
+    p->transactions = NULL;
+    p->transaction_count = 0;
+    p->transaction_capacity = 0;
+
+    p->next = NULL;
+    
+    return p;
+}
+
+Person* create_person(Arena* arena, PersonTable* table, char* name, int balance)
+{
+    return person_create_full(arena, table, name, balance, 0., 0, 0);
+}
+
+// Names are not checked for uniqueness, see kitty_add_person. The person
+// goes first, sort_persons_by_name puts it in its place on the next save.
+Person* person_add(Person **head, Person *person)
+{
+    person->next = *head;
+    *head = person;
     return person;
 }
 
@@ -105,51 +150,62 @@ void person_remove(Person **head, Person *person_to_remove)
     return;
 }
 
-Person* person_rename(Person* persons, Person *person, char *new_name)
+// names are not checked for uniqueness, see kitty_rename_person
+Person* person_rename(Arena* arena, Person *person, char *new_name)
 {
-    if (get_person_by_name(persons, new_name)){
-        return NULL;
-    }
-
-    free(person->name);
     person->name_length = strlen(new_name);
-    person->name = malloc(person->name_length + 1);
-    strcpy(person->name, new_name);
+    person->name = arena_strdup(arena, new_name);
 
     return person;
 }
 
-Person *get_person_by_name(Person *persons, char *name)
+static Person* merge_persons_by_name(Person *a, Person *b)
 {
-    Person *p = persons;
-    while (p) {
-        if (strcmp(p->name, name) == 0) {
-            return p;
+    Person *head = NULL;
+    Person **tail = &head;
+    while (a && b) {
+        if (strcmp(a->name, b->name) <= 0) {
+            *tail = a;
+            a = a->next;
+        } else {
+            *tail = b;
+            b = b->next;
         }
-        p = p->next;
+        tail = &(*tail)->next;
     }
-    return NULL;
+    *tail = a ? a : b;
+
+    return head;
 }
 
-void sort_persons_by_name(Person **old_head)
+static Person* merge_sort_persons_by_name(Person *head)
 {
-    Person* new_head = NULL;
+    if (!head || !head->next) {
+        return head;
+    }
 
-    while (*old_head) {
-        // find first
-        Person* first = *old_head;
-        for (Person* p = *old_head; p; p = p->next) {
-            if (strcmp(p->name, first->name) <= 0) {
-                first = p;
-            }
-        }
+    // split in the middle
+    Person *slow = head;
+    for (Person *fast = head->next; fast && fast->next; fast = fast->next->next) {
+        slow = slow->next;
+    }
+    Person *second = slow->next;
+    slow->next = NULL;
+
+    return merge_persons_by_name(merge_sort_persons_by_name(head), merge_sort_persons_by_name(second));
+}
 
-        person_remove(old_head, first);
-        person_add(&new_head, first);
+void sort_persons_by_name(Person **head)
+{
+    // usually only a new person is out of place, if at all
+    bool sorted = true;
+    for (Person *p = *head; p && p->next && sorted; p = p->next) {
+        sorted = strcmp(p->name, p->next->name) <= 0;
     }
 
-    *old_head = new_head;    
-    return;
+    if (!sorted) {
+        *head = merge_sort_persons_by_name(*head);
+    }
 }
 
 int get_person_count(Person *head)
@@ -159,4 +215,56 @@ int get_person_count(Person *head)
         count++;
     }
     return count;
-}
\ No newline at end of file
+}
+
+// returns a table of the persons indexed by id, NULL where there is none
+Person** person_id_table(Person *head, int *size)
+{
+    *size = 0;
+    for (Person *p = head; p; p = p->next) {
+        if (p->id >= *size) {
+            *size = p->id + 1;
+        }
+    }
+
+    Person **table = calloc(*size + 1, sizeof(Person*));
+    for (Person *p = head; p; p = p->next) {
+        if (p->id != PERSON_NO_ID) {
+            table[p->id] = p;
+        }
+    }
+    return table;
+}
+
+// indices are added in ascending order, a transaction with several deltas of
+// the person is only added once
+void person_add_transaction(Person *person, size_t index)
+{
+    size_t count = person->transaction_count;
+    if (count && person->transactions[count - 1] == index) {
+        return;
+    }
+
+    if (count == person->transaction_capacity) {
+        person->transaction_capacity = count ? 2 * count : 8;
+        person->transactions = realloc(person->transactions, sizeof(size_t) * person->transaction_capacity);
+    }
+    person->transactions[person->transaction_count++] = index;
+}
+
+// only the last transaction can be removed, as done by undo
+void person_remove_transaction(Person *person, size_t index)
+{
+    size_t count = person->transaction_count;
+    if (count && person->transactions[count - 1] == index) {
+        person->transaction_count--;
+    }
+}
+
+void person_free_transactions(Person *person)
+{
+    free(person->transactions);
+    person->transactions = NULL;
+    person->transaction_count = 0;
+    person->transaction_capacity = 0;
+}
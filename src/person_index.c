@@ -0,0 +1,121 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+
+#include "person_index.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "person.h"
+
+// keeps probe sequences short
+#define PERSON_INDEX_MAX_LOAD(capacity) ((capacity) / 4 * 3)
+
+static size_t hash_name(const char *name)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *c = (const unsigned char *) name; *c; c++) {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+    return (size_t) hash;
+}
+
+// slot holding name, or the empty slot where it belongs
+static size_t find_slot(const PersonIndex *index, const char *name)
+{
+    size_t mask = index->capacity - 1;
+    size_t i = hash_name(name) & mask;
+    while (index->slots[i] && strcmp(index->slots[i]->name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+PersonIndex* person_index_alloc(size_t expected)
+{
+    PersonIndex *index = malloc(sizeof(PersonIndex));
+    index->capacity = 16;
+    while (PERSON_INDEX_MAX_LOAD(index->capacity) < expected) {
+        index->capacity *= 2;
+    }
+    index->slots = calloc(index->capacity, sizeof(Person*));
+    index->count = 0;
+    return index;
+}
+
+void person_index_free(PersonIndex *index)
+{
+    free(index->slots);
+    free(index);
+}
+
+static void person_index_grow(PersonIndex *index)
+{
+    Person **old_slots = index->slots;
+    size_t old_capacity = index->capacity;
+
+    index->capacity *= 2;
+    index->slots = calloc(index->capacity, sizeof(Person*));
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i]) {
+            index->slots[find_slot(index, old_slots[i]->name)] = old_slots[i];
+        }
+    }
+
+    free(old_slots);
+}
+
+Person* person_index_find(const PersonIndex *index, const char *name)
+{
+    return index->slots[find_slot(index, name)];
+}
+
+void person_index_insert(PersonIndex *index, Person *person)
+{
+    if (index->count + 1 > PERSON_INDEX_MAX_LOAD(index->capacity)) {
+        person_index_grow(index);
+    }
+
+    index->slots[find_slot(index, person->name)] = person;
+    index->count++;
+}
+
+void person_index_remove(PersonIndex *index, const Person *person)
+{
+    size_t mask = index->capacity - 1;
+    size_t hole = find_slot(index, person->name);
+    if (index->slots[hole] != person) {
+        return;
+    }
+    index->slots[hole] = NULL;
+    index->count--;
+
+    // move back entries of the probe sequence that would no longer be found
+    for (size_t i = (hole + 1) & mask; index->slots[i]; i = (i + 1) & mask) {
+        size_t home = hash_name(index->slots[i]->name) & mask;
+        // an entry may fill the hole unless its home lies cyclically in (hole, i]
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index->slots[hole] = index->slots[i];
+            index->slots[i] = NULL;
+            hole = i;
+        }
+    }
+}
@@ -0,0 +1,243 @@
+/*
+ * This file is part of Coffeekitty.
+ * 
+ * Copyright (C) 2025 Alexander Hahn
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the European Union Public License (EUPL), version 1.2.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * European Union Public License for more details.
+ * 
+ * You should have received a copy of the European Union Public License
+ * along with this program. If not, see <https://joinup.ec.europa.eu/collection/eupl/eupl-text-eupl-12>.
+ */
+
+
+#include "protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#if defined(__linux__)
+    #include <linux/limits.h>
+#elif defined(__APPLE__)
+    #include <sys/syslimits.h>
+#endif
+
+#include "storage.h"
+
+int send_all(int fd, const void* buffer, size_t length)
+{
+    const char* data = buffer;
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return 1;
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+int recv_all(int fd, void* buffer, size_t length)
+{
+    char* data = buffer;
+    while (length > 0) {
+        ssize_t received = read(fd, data, length);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return 1;
+        data += received;
+        length -= received;
+    }
+    return 0;
+}
+
+static int send_uint(int fd, uint32_t value)
+{
+    return send_all(fd, &value, sizeof(value));
+}
+
+static int send_string(int fd, const char* string)
+{
+    uint32_t length = strlen(string);
+    return send_uint(fd, length) || send_all(fd, string, length);
+}
+
+static char* recv_string(int fd)
+{
+    uint32_t length;
+    if (recv_all(fd, &length, sizeof(length)) || length > KITTY_PROTOCOL_MAX_STRING)
+        return NULL;
+
+    char* string = malloc(length + 1);
+    if (recv_all(fd, string, length)) {
+        free(string);
+        return NULL;
+    }
+    string[length] = '\0';
+    return string;
+}
+
+int send_request(int fd, const char* cwd, const char* kitty, int argc, char** argv)
+{
+    if (send_uint(fd, KITTY_PROTOCOL_VERSION) || send_uint(fd, argc) || send_string(fd, cwd) || send_string(fd, kitty))
+        return 1;
+
+    for (int i = 0; i < argc; i++) {
+        if (send_string(fd, argv[i]))
+            return 1;
+    }
+    return 0;
+}
+
+char** recv_request(int fd, int* argc, char** cwd, char** kitty)
+{
+    uint32_t version, count;
+    if (recv_all(fd, &version, sizeof(version)) || version != KITTY_PROTOCOL_VERSION)
+        return NULL;
+    if (recv_all(fd, &count, sizeof(count)) || count < 1 || count > KITTY_PROTOCOL_MAX_ARGS)
+        return NULL;
+
+    *cwd = recv_string(fd);
+    if (!*cwd)
+        return NULL;
+    *kitty = recv_string(fd);
+    if (!*kitty) {
+        free(*cwd);
+        return NULL;
+    }
+
+    // NULL-terminated like the argv of main
+    char** argv = calloc(count + 1, sizeof(char*));
+    for (uint32_t i = 0; i < count; i++) {
+        argv[i] = recv_string(fd);
+        if (!argv[i]) {
+            free_request(i, argv, *cwd, *kitty);
+            return NULL;
+        }
+    }
+
+    *argc = count;
+    return argv;
+}
+
+void free_request(int argc, char** argv, char* cwd, char* kitty)
+{
+    for (int i = 0; i < argc; i++) {
+        free(argv[i]);
+    }
+    free(argv);
+    free(cwd);
+    free(kitty);
+}
+
+int connect_daemon()
+{
+    const char* path = get_socket_file_path();
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+        return -1;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr*) &address, sizeof(address))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int forward_command(int fd, int argc, char** argv)
+{
+    // the daemon owns the database from here on, so failures are not retried locally
+    signal(SIGPIPE, SIG_IGN);
+    int rval = 1;
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        strcpy(cwd, "/");
+    }
+
+    if (send_request(fd, cwd, get_kitty_name(), argc, argv)) {
+        fprintf(stderr, "Failed to send command to coffeekittyd\n");
+        close(fd);
+        return rval;
+    }
+
+    // e.g. a batch of remove is read from our stdin
+    struct pollfd fds[2] = {
+        {fd, POLLIN, 0},
+        {STDIN_FILENO, POLLIN, 0},
+    };
+    int nfds = 2;
+    char buffer[4096];
+    bool terminated = false; // the NUL before the status has been received
+
+    while (true) {
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (nfds == 2 && fds[1].revents) {
+            ssize_t length = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (length <= 0) {
+                shutdown(fd, SHUT_WR);
+                nfds = 1;
+            } else if (send_all(fd, buffer, length)) {
+                nfds = 1;
+            }
+        }
+
+        if (fds[0].revents) {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0)
+                break;
+
+            if (terminated) {
+                rval = (unsigned char) buffer[0];
+                close(fd);
+                return rval;
+            }
+
+            char* end = memchr(buffer, '\0', length);
+            fwrite(buffer, 1, end ? end - buffer : length, stdout);
+            if (end) {
+                terminated = true;
+                if (end + 1 < buffer + length) {
+                    rval = (unsigned char) end[1];
+                    close(fd);
+                    return rval;
+                }
+            }
+        }
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "Lost connection to coffeekittyd\n");
+    close(fd);
+    return rval;
+}
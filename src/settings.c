@@ -25,6 +25,9 @@ Settings* settings_alloc(Currency *c)
 {
     Settings *s = malloc(sizeof(Settings));
     s->currency = c;
+    s->journal = true;
+    s->checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+    s->indent = true;
     return s;
 }
 
@@ -21,13 +21,19 @@
 #include "settings.h"
 #include "currency.h"
 #include "person.h"
+#include "person_index.h"
 #include "transactions.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
+#include <libxml/xmlwriter.h>
 
 #if defined(__linux__)
     #include <linux/limits.h>
@@ -35,283 +41,396 @@
     #include <sys/syslimits.h>
 #endif
 
-CounterDelta* xml_parse_counter_delta(const xmlNode* counter_delta_node, Person* persons)
-{
-    xmlChar *target_name = xmlGetProp(counter_delta_node, (const xmlChar*) "target");
-    xmlChar *value_string = xmlGetProp(counter_delta_node, (const xmlChar*) "value");
+/* loading functions
+ *
+ * data.xml is read with a streaming reader: objects are created directly from
+ * the element events and attribute values are parsed in place, without
+ * building a tree. Persons have to precede the transactions referring to
+ * them, which is the order save_kitty_to_xml() writes them in.
+ */
 
-    CounterDelta* counter_delta = counter_delta_alloc(atoi((char*) value_string), NULL);
-    if (target_name) {
-        Person* target = get_person_by_name(persons, (char*) target_name);
-        counter_delta->target = target;
-    }
+typedef struct XmlLoadState {
+    bool has_storage_info;
+    long generation;
+    Settings *settings;
+
+    bool has_kitty;
+    int balance;
+    int price;
+    int packs;
+    int counter;
+
+    bool has_persons;
+    Person *persons;
+    Person *last_person;
+    PersonTable person_table;
+    PersonIndex *person_index; // for resolving names, of old databases
+    Person **persons_by_id; // for resolving the targets of deltas
+    int persons_by_id_size;
+    Arena *arena;
+
+    bool has_transactions;
+    TransactionLog transactions;
+} XmlLoadState;
+
+static bool xml_name_is(xmlTextReaderPtr reader, const char *name)
+{
+    return xmlStrEqual(xmlTextReaderConstName(reader), (const xmlChar*) name);
+}
 
-    xmlFree(target_name);
-    xmlFree(value_string);
+static const char* xml_value(xmlTextReaderPtr reader)
+{
+    return (const char*) xmlTextReaderConstValue(reader);
+}
 
-    return counter_delta;
+// the current version, or the first one, which refers to persons by name
+static bool storage_version_is_supported(const char *version)
+{
+    return strcmp(version, KITTY_STORAGE_VERSION) == 0 || strcmp(version, KITTY_STORAGE_VERSION_FIRST) == 0;
 }
 
-CounterDelta* xml_parse_counter_deltas(const xmlNode* counter_deltas_node, Person* persons)
+bool xml_read_storage_info(xmlTextReaderPtr reader, XmlLoadState *state)
 {
-    CounterDelta *counter_deltas = NULL;
-    for (xmlNode *delta_node = counter_deltas_node->children; delta_node; delta_node = delta_node->next) {
-        if (delta_node->type == XML_ELEMENT_NODE && xmlStrcmp(delta_node->name, (const xmlChar*) "counter_delta") == 0) {
-            CounterDelta* delta = xml_parse_counter_delta(delta_node, persons);
-            counter_delta_add(&counter_deltas, delta);
+    bool supported = false;
+    while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+        if (xml_name_is(reader, "version")) {
+            supported = storage_version_is_supported(xml_value(reader));
+            if (!supported) {
+                fprintf(stderr, "Unsupported storage version %s, this coffeekitty supports %s and %s\n",
+                    xml_value(reader), KITTY_STORAGE_VERSION_FIRST, KITTY_STORAGE_VERSION);
+            }
+        } else if (xml_name_is(reader, "generation")) {
+            state->generation = atol(xml_value(reader));
         }
     }
-    return counter_deltas;
+
+    return supported;
 }
 
-PacksDelta* xml_parse_packs_delta(const xmlNode* packs_delta_node)
+Currency* xml_read_currency(xmlTextReaderPtr reader)
 {
-    xmlChar *value_string = xmlGetProp(packs_delta_node, (const xmlChar*) "value");
-    PacksDelta* packs_delta = packs_delta_alloc(atoi((char*) value_string));
+    char isoname[4] = {0};
+    bool prefix = false;
+    int subunit_digits = 0;
+    char decimal = '\0';
+
+    int found = 0;
+    while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+        if (xml_name_is(reader, "isoname")) {
+            snprintf(isoname, sizeof(isoname), "%s", xml_value(reader));
+            found |= 1;
+        } else if (xml_name_is(reader, "prefix")) {
+            prefix = (bool) atoi(xml_value(reader));
+            found |= 2;
+        } else if (xml_name_is(reader, "subunit_digits")) {
+            subunit_digits = atoi(xml_value(reader));
+            found |= 4;
+        } else if (xml_name_is(reader, "decimal")) {
+            decimal = xml_value(reader)[0];
+            found |= 8;
+        }
+    }
 
-    xmlFree(value_string);
+    if (found != 15) {
+        return NULL;
+    }
 
-    return packs_delta;
+    return currency_alloc(isoname, prefix, subunit_digits, decimal);
 }
 
-PacksDelta* xml_parse_packs_deltas(const xmlNode* packs_deltas_node)
+void xml_read_storage_settings(xmlTextReaderPtr reader, Settings *settings)
 {
-    PacksDelta *packs_deltas = NULL;
-    for (xmlNode *delta_node = packs_deltas_node->children; delta_node; delta_node = delta_node->next) {
-        if (delta_node->type == XML_ELEMENT_NODE && xmlStrcmp(delta_node->name, (const xmlChar*) "packs_delta") == 0) {
-            PacksDelta* delta = xml_parse_packs_delta(delta_node);
-            packs_delta_add(&packs_deltas, delta);
+    while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+        if (xml_name_is(reader, "checkpoint_interval")) {
+            settings->checkpoint_interval = atoi(xml_value(reader));
+        } else if (xml_name_is(reader, "journal")) {
+            settings->journal = (bool) atoi(xml_value(reader));
+        } else if (xml_name_is(reader, "indent")) {
+            settings->indent = (bool) atoi(xml_value(reader));
         }
     }
-    return packs_deltas;
 }
 
-BalanceDelta* xml_parse_balance_delta(const xmlNode* balance_delta_node, Person* persons, const Settings* settings)
+bool xml_read_kitty(xmlTextReaderPtr reader, XmlLoadState *state)
 {
-    xmlChar *target_name = xmlGetProp(balance_delta_node, (const xmlChar*) "target");
-    xmlChar *value_string = xmlGetProp(balance_delta_node, (const xmlChar*) "value");
-
-    BalanceDelta* balance_delta = balance_delta_alloc(currency_value_alloc(atoi((char*) value_string), settings->currency), NULL);
-    if (target_name) {
-        Person* target = get_person_by_name(persons, (char*) target_name);
-        balance_delta->target = target;
+    int found = 0;
+    while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+        if (xml_name_is(reader, "balance")) {
+            state->balance = atoi(xml_value(reader));
+            found |= 1;
+        } else if (xml_name_is(reader, "price")) {
+            state->price = atoi(xml_value(reader));
+            found |= 2;
+        } else if (xml_name_is(reader, "packs")) {
+            state->packs = atoi(xml_value(reader));
+            found |= 4;
+        } else if (xml_name_is(reader, "counter")) {
+            state->counter = atoi(xml_value(reader));
+            found |= 8;
+        }
     }
 
-    xmlFree(target_name);
-    xmlFree(value_string);
-
-    return balance_delta;
+    return found == 15;
 }
 
-BalanceDelta* xml_parse_balance_deltas(const xmlNode* balance_deltas_node, Person* persons, const Settings* settings)
+Person* xml_read_person(xmlTextReaderPtr reader, Arena *arena, PersonTable *table)
 {
-    BalanceDelta *balance_deltas = NULL;
-    for (xmlNode *delta_node = balance_deltas_node->children; delta_node; delta_node = delta_node->next) {
-        if (delta_node->type == XML_ELEMENT_NODE && xmlStrcmp(delta_node->name, (const xmlChar*) "balance_delta") == 0) {
-            BalanceDelta* delta = xml_parse_balance_delta(delta_node, persons, settings);
-            balance_delta_add(&balance_deltas, delta);
+    int id = PERSON_NO_ID;
+    bool removed = false;
+    int balance = 0;
+    float thirst = 0.;
+    int current_coffees = 0;
+    int total_coffees = 0;
+
+    int found = 0;
+    while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+        if (xml_name_is(reader, "id")) {
+            id = atoi(xml_value(reader));
+        } else if (xml_name_is(reader, "removed")) {
+            removed = atoi(xml_value(reader));
+        } else if (xml_name_is(reader, "balance")) {
+            balance = atoi(xml_value(reader));
+            found |= 1;
+        } else if (xml_name_is(reader, "thirst")) {
+            thirst = atof(xml_value(reader));
+            found |= 2;
+        } else if (xml_name_is(reader, "current_coffees")) {
+            current_coffees = atoi(xml_value(reader));
+            found |= 4;
+        } else if (xml_name_is(reader, "total_coffees")) {
+            total_coffees = atoi(xml_value(reader));
+            found |= 8;
         }
     }
-    return balance_deltas;
+
+    // the name is only valid until the reader moves on, so it is read last
+    if (found != 15 || id < PERSON_NO_ID || id >= PERSON_MAX_ID
+        || xmlTextReaderMoveToAttribute(reader, (const xmlChar*) "name") != 1) {
+        return NULL;
+    }
+
+    Person *p = person_create_full(arena, table, (char*) xml_value(reader), balance, thirst, current_coffees, total_coffees);
+    p->id = id;
+    table->removed[p->row] = removed;
+    return p;
 }
 
-Transaction* xml_parse_transaction(const xmlNode* transaction_node, Person* persons, const Settings* settings)
+void xml_read_transaction(xmlTextReaderPtr reader, Transaction *t)
 {
-    xmlChar* type_string = xmlGetProp(transaction_node, (const xmlChar*) "type");
-    enum transaction_type type = atoi((char*) type_string);
-    xmlChar* timestamp_string = xmlGetProp(transaction_node, (const xmlChar*) "timestamp");
-    long timestamp;
-    if (!timestamp_string)
-        timestamp = 0;
-    else
-        timestamp = atol((char*) timestamp_string);
+    enum transaction_type type = 0;
+    long timestamp = 0;
+
+    while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+        if (xml_name_is(reader, "type")) {
+            type = atoi(xml_value(reader));
+        } else if (xml_name_is(reader, "timestamp")) {
+            timestamp = atol(xml_value(reader));
+        }
+    }
 
-    xmlFree(type_string);
-    xmlFree(timestamp_string);
+    transaction_init(t, type, timestamp);
+}
 
-    Transaction* transaction = transaction_alloc(type, timestamp);
+// parses value and target of a delta, a missing target refers to the kitty.
+// Databases written before there were ids refer to the target by name.
+int xml_read_delta(xmlTextReaderPtr reader, const XmlLoadState *state, Person **target)
+{
+    int value = 0;
+
+    *target = NULL;
+    while (xmlTextReaderMoveToNextAttribute(reader) == 1) {
+        if (xml_name_is(reader, "value")) {
+            value = atoi(xml_value(reader));
+        } else if (xml_name_is(reader, "target_id")) {
+            int id = atoi(xml_value(reader));
+            if (id >= 0 && id < state->persons_by_id_size) {
+                *target = state->persons_by_id[id];
+            }
+        } else if (xml_name_is(reader, "target")) {
+            *target = person_index_find(state->person_index, xml_value(reader));
+        }
+    }
 
-    xmlNode *balance_deltas_node = NULL,
-    *packs_deltas_node = NULL,
-    *counter_deltas_node = NULL;
+    return value;
+}
 
-    // get nodes
-    for (xmlNode *node = transaction_node->children; node; node = node->next) {
-        if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, (const xmlChar*) "balance_deltas") == 0) {
-            balance_deltas_node = node;
-        } else if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, (const xmlChar*) "packs_deltas") == 0) {
-            packs_deltas_node = node;
-        } else if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, (const xmlChar*) "counter_deltas") == 0) {
-            counter_deltas_node = node;
+// returns false if the id is already taken
+static bool xml_register_person_id(XmlLoadState *state, Person *p)
+{
+    if (p->id >= state->persons_by_id_size) {
+        int size = state->persons_by_id_size ? state->persons_by_id_size : 64;
+        while (size <= p->id) {
+            size *= 2;
         }
+        state->persons_by_id = realloc(state->persons_by_id, sizeof(Person*) * size);
+        memset(state->persons_by_id + state->persons_by_id_size, 0,
+            sizeof(Person*) * (size - state->persons_by_id_size));
+        state->persons_by_id_size = size;
     }
 
-    if (balance_deltas_node) {
-        transaction->balance_delta_head = xml_parse_balance_deltas(balance_deltas_node, persons, settings);
-    }
-    if (packs_deltas_node) {
-        transaction->packs_delta_head = xml_parse_packs_deltas(packs_deltas_node);
+    if (state->persons_by_id[p->id]) {
+        return false;
     }
-    if (counter_deltas_node) {
-        transaction->counter_delta_head = xml_parse_counter_deltas(counter_deltas_node, persons);
-    }
-
-    return transaction;
+    state->persons_by_id[p->id] = p;
+    return true;
 }
 
-Transaction* xml_parse_transactions(const xmlNode* transactions_node, Person* persons, const Settings* settings)
+int xml_read_element(xmlTextReaderPtr reader, XmlLoadState *state)
 {
-    Transaction *transactions = NULL;
-    for (xmlNode *transaction_node = transactions_node->children; transaction_node; transaction_node = transaction_node->next) {
-        if (transactions_node->type == XML_ELEMENT_NODE && xmlStrcmp(transaction_node->name, (const xmlChar*) "transaction") == 0) {
-            Transaction* t = xml_parse_transaction(transaction_node, persons, settings);
-            if (!t) continue;
-            transaction_add(&transactions, t);
+    Transaction *t = transaction_log_last(&state->transactions);
+    Person *target;
+
+    if (xml_name_is(reader, "storage_info")) {
+        state->has_storage_info = xml_read_storage_info(reader, state);
+        if (!state->has_storage_info) {
+            return 1;
+        }
+    } else if (xml_name_is(reader, "currency")) {
+        Currency *c = xml_read_currency(reader);
+        if (!c || state->settings) {
+            currency_free(c);
+            return 1;
+        }
+        state->settings = settings_alloc(c);
+    } else if (xml_name_is(reader, "storage")) {
+        if (state->settings) {
+            xml_read_storage_settings(reader, state->settings);
         }
+    } else if (xml_name_is(reader, "kitty")) {
+        state->has_kitty = xml_read_kitty(reader, state);
+        if (!state->has_kitty) {
+            return 1;
+        }
+    } else if (xml_name_is(reader, "persons")) {
+        state->has_persons = true;
+    } else if (xml_name_is(reader, "person")) {
+        Person *p = xml_read_person(reader, state->arena, &state->person_table);
+        // duplicates are dropped, they stay in the arena until it is freed
+        if (p && !person_index_find(state->person_index, p->name)
+            && (p->id == PERSON_NO_ID || xml_register_person_id(state, p))) {
+            if (state->last_person) {
+                state->last_person->next = p;
+            } else {
+                state->persons = p;
+            }
+            state->last_person = p;
+            person_index_insert(state->person_index, p);
+        } else if (p) {
+            state->person_table.removed[p->row] = true;
+        }
+    } else if (xml_name_is(reader, "transactions")) {
+        state->has_transactions = true;
+    } else if (xml_name_is(reader, "transaction")) {
+        Transaction transaction;
+        xml_read_transaction(reader, &transaction);
+        transaction_log_push(&state->transactions, &transaction);
+    } else if (t && xml_name_is(reader, "balance_delta")) {
+        int value = xml_read_delta(reader, state, &target);
+        transaction_add_delta(t, state->arena, BALANCE_DELTA, value, target);
+    } else if (t && xml_name_is(reader, "packs_delta")) {
+        int value = xml_read_delta(reader, state, &target);
+        transaction_add_delta(t, state->arena, PACKS_DELTA, value, NULL);
+    } else if (t && xml_name_is(reader, "counter_delta")) {
+        int value = xml_read_delta(reader, state, &target);
+        transaction_add_delta(t, state->arena, COUNTER_DELTA, value, target);
     }
-    return transactions;
+
+    return 0;
 }
 
-Person* xml_parse_person(const xmlNode* person_node, const Settings* settings)
+const char* get_config_directory()
 {
-    xmlChar *name = xmlGetProp(person_node, (const xmlChar*) "name");
-    xmlChar *balance = xmlGetProp(person_node, (const xmlChar*) "balance");
-    xmlChar *thirst = xmlGetProp(person_node, (const xmlChar*) "thirst");
-    xmlChar *current_coffees = xmlGetProp(person_node, (const xmlChar*) "current_coffees");
-    xmlChar *total_coffees = xmlGetProp(person_node, (const xmlChar*) "total_coffees");
+    const char* directory = ".coffeekitty";
+    const char* home = getenv("HOME");
 
-    if (!name || !balance || !thirst || !current_coffees || !total_coffees) {
-        xmlFree(name);
-        xmlFree(balance);
-        xmlFree(thirst);
-        xmlFree(current_coffees);
-        xmlFree(total_coffees);
-        return NULL;
+    _Thread_local static char rval[PATH_MAX];
+    if (!home) {
+        snprintf(rval, PATH_MAX, "%s", directory);
+    } else {
+        snprintf(rval, PATH_MAX, "%s/%s", home, directory);
     }
+    return rval;
+}
 
-    Person *p = person_create_full(
-        (char*)name, 
-        atoi((char*)balance), 
-        settings->currency, 
-        atof((char*)thirst), 
-        atoi((char*)current_coffees), 
-        atoi((char*)total_coffees));
+/* kitties: the default kitty lives in the config directory itself, named
+ * ones in kitties/<name> below it */
 
-    xmlFree(name);
-    xmlFree(balance);
-    xmlFree(thirst);
-    xmlFree(current_coffees);
-    xmlFree(total_coffees);
-    return p;
-}
+_Thread_local static char kitty_name[KITTY_NAME_MAX + 1];
 
-Person* xml_parse_persons(const xmlNode* persons_node, const Settings* settings)
+static bool kitty_name_is_valid(const char* name)
 {
-    Person *persons = NULL;
-    for (xmlNode *person_node = persons_node->children; person_node; person_node = person_node->next) {
-        if (person_node->type == XML_ELEMENT_NODE && xmlStrcmp(person_node->name, (const xmlChar*) "person") == 0) {
-            Person *p = xml_parse_person(person_node, settings);
-            if (!p) continue;
-            person_add(&persons, p);
-        }
+    size_t length = strlen(name);
+    if (length == 0 || length > KITTY_NAME_MAX || name[0] == '.') {
+        return false;
     }
-    return persons;
+    return strspn(name, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._-") == length;
 }
 
-Kitty* xml_parse_kitty(const xmlNode* node, Person* persons, Settings* settings, Transaction* transactions)
+// an empty name selects the default kitty
+int select_kitty(const char* name)
 {
-    xmlChar *balance = xmlGetProp(node, (const xmlChar*) "balance");
-    xmlChar *price = xmlGetProp(node, (const xmlChar*) "price");
-    xmlChar *packs = xmlGetProp(node, (const xmlChar*) "packs");
-    xmlChar *counter = xmlGetProp(node, (const xmlChar*) "counter");
-
-    if (!balance || !price || !packs || !counter) {
-        xmlFree(balance);
-        xmlFree(price);
-        xmlFree(packs);
-        xmlFree(counter);
-        return NULL;
+    if (name[0] != '\0' && !kitty_name_is_valid(name)) {
+        return 1;
     }
-
-    Kitty *kitty = create_kitty(
-        atoi((char*)balance),
-        atoi((char*)price),
-        atoi((char*)packs),
-        atoi((char*)counter),
-        settings, persons, transactions);
-
-    xmlFree(balance);
-    xmlFree(price);
-    xmlFree(packs);
-    xmlFree(counter);
-
-    return kitty;
+    snprintf(kitty_name, sizeof(kitty_name), "%s", name);
+    return 0;
 }
 
-Currency* xml_parse_currency(const xmlNode* currency_node)
+const char* get_kitty_name()
 {
-    xmlChar *isoname = xmlGetProp(currency_node, (const xmlChar*) "isoname");
-    xmlChar *prefix = xmlGetProp(currency_node, (const xmlChar*) "prefix");
-    xmlChar *subunit_digits = xmlGetProp(currency_node, (const xmlChar*) "subunit_digits");
-    xmlChar *decimal = xmlGetProp(currency_node, (const xmlChar*) "decimal");
+    return kitty_name;
+}
 
-    if (!isoname || !subunit_digits || !decimal || !prefix) {
-        xmlFree(isoname);
-        xmlFree(prefix);
-        xmlFree(subunit_digits);
-        xmlFree(decimal);
-        return NULL;
+const char* get_kitty_directory()
+{
+    if (kitty_name[0] == '\0') {
+        return get_config_directory();
     }
 
-    Currency *c = currency_alloc(
-        (char*)isoname,
-        (bool) atoi((char*) prefix),
-        atoi((char*)subunit_digits),
-        decimal[0]);
+    _Thread_local static char rval[PATH_MAX];
+    snprintf(rval, PATH_MAX, "%s/kitties/%s", get_config_directory(), kitty_name);
+    return rval;
+}
 
-    xmlFree(isoname);
-    xmlFree(subunit_digits);
-    xmlFree(decimal);
-    xmlFree(prefix);
+const char* get_config_file_path()
+{
+    const char* filename = "data.xml";
 
-    return c;
+    _Thread_local static char rval[PATH_MAX];
+    snprintf(rval, PATH_MAX, "%s/%s", get_kitty_directory(), filename);
+    return rval;
 }
 
-Settings* xml_parse_settings(const xmlNode* settings_node)
+const char* get_cache_file_path()
 {
-    xmlNode *currency_node = NULL;
+    const char* filename = "data.bin";
 
-    for (xmlNode *node = settings_node -> children; node; node=node->next) {
-        if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, (const xmlChar*) "currency") == 0) {
-            currency_node = node;
-        }
-    }
+    _Thread_local static char rval[PATH_MAX];
+    snprintf(rval, PATH_MAX, "%s/%s", get_kitty_directory(), filename);
+    return rval;
+}
 
-    if (!currency_node) {
-        return NULL;
-    }
+const char* get_journal_file_path()
+{
+    const char* filename = "data.journal";
 
-    Currency *c = xml_parse_currency(currency_node);
-    return settings_alloc(c);
+    _Thread_local static char rval[PATH_MAX];
+    snprintf(rval, PATH_MAX, "%s/%s", get_kitty_directory(), filename);
+    return rval;
 }
 
-const char* get_config_directory()
+const char* get_lock_file_path()
 {
-    const char* directory = ".coffeekitty";
-    const char* home = getenv("HOME");
+    const char* filename = "data.lock";
 
     _Thread_local static char rval[PATH_MAX];
-    if (!home) {
-        snprintf(rval, PATH_MAX, "%s", directory);
-    } else {
-        snprintf(rval, PATH_MAX, "%s/%s", home, directory);
-    }
+    snprintf(rval, PATH_MAX, "%s/%s", get_kitty_directory(), filename);
     return rval;
 }
 
-const char* get_config_file_path()
+const char* get_socket_file_path()
 {
-    const char* filename = "data.xml";
+    const char* filename = "coffeekittyd.sock";
 
     _Thread_local static char rval[PATH_MAX];
     snprintf(rval, PATH_MAX, "%s/%s", get_config_directory(), filename);
@@ -325,244 +444,337 @@ int mkdir_p(const char *path)
     return system(buffer);
 }
 
-Kitty *load_kitty_from_xml(const char *path)
+/* atomic files
+ *
+ * A file is replaced by writing a temporary file next to it, syncing it and
+ * renaming it over the original. Readers and crashes see either the old or
+ * the new contents, never a partial file.
+ */
+
+// gives a new file the permissions of path instead of those of the umask,
+// nothing to do if path does not exist
+int copy_permissions(FILE *file, const char *path)
 {
-    xmlDocPtr doc = xmlReadFile(path, NULL, 0);
-    if (!doc) {
-        fprintf(stderr, "Failed to parse %s\n", path);
+    struct stat original;
+    if (stat(path, &original) == 0 && fchmod(fileno(file), original.st_mode & 07777)) {
+        fprintf(stderr, "Failed to copy the permissions of %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+FILE* atomic_open(const char *path, char *temp_path, size_t size)
+{
+    snprintf(temp_path, size, "%s.%i.tmp", path, (int) getpid());
+    FILE *file = fopen(temp_path, "wb");
+
+    // the replacement keeps the permissions of the original
+    if (file && copy_permissions(file, path)) {
+        atomic_abort(file, temp_path);
         return NULL;
     }
+    return file;
+}
 
-    xmlNode *settings_node = NULL,
-    *kitty_node = NULL,
-    *persons_node = NULL,
-    *transactions_node = NULL;
-
-    // get nodes
-    xmlNode *root = xmlDocGetRootElement(doc);
-    for (xmlNode *node = root->children; node; node = node->next) {
-        if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, (const xmlChar*) "settings") == 0) {
-            settings_node = node;
-        } else if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, (const xmlChar*) "kitty") == 0) {
-            kitty_node = node;
-        } else if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, (const xmlChar*) "persons") == 0) {
-            persons_node = node;
-        } else if (node->type == XML_ELEMENT_NODE && xmlStrcmp(node->name, (const xmlChar*) "transactions") == 0) {
-            transactions_node = node;
-        }
+// creating or renaming a file in it is only durable once the directory is synced
+int sync_directory(const char *path)
+{
+    char directory[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        snprintf(directory, sizeof(directory), ".");
+    } else {
+        snprintf(directory, sizeof(directory), "%.*s", (int) (slash - path + 1), path);
     }
 
-    if (settings_node == NULL || kitty_node == NULL || persons_node == NULL || transactions_node == NULL) {
-        fprintf(stderr, "Failed to parse %s\n", path);
-        return NULL;
+    int fd = open(directory, O_RDONLY);
+    if (fd < 0) {
+        return 1;
     }
+    int failed = fsync(fd) != 0;
+    failed |= close(fd) != 0;
+    return failed;
+}
+
+int atomic_commit(FILE *file, const char *temp_path, const char *path)
+{
+    bool failed = fflush(file) != 0;
+    failed |= ferror(file) != 0;
+    failed |= fsync(fileno(file)) != 0;
+    failed |= fclose(file) != 0;
+    if (failed || rename(temp_path, path)) {
+        remove(temp_path);
+        return 1;
+    }
+    return sync_directory(path);
+}
 
-    Settings *settings = xml_parse_settings(settings_node);
-    if (!settings) {
+void atomic_abort(FILE *file, const char *temp_path)
+{
+    fclose(file);
+    remove(temp_path);
+}
+
+Kitty *load_kitty_from_xml(const char *path)
+{
+    xmlTextReaderPtr reader = xmlReaderForFile(path, NULL, 0);
+    if (!reader) {
+        fprintf(stderr, "Failed to parse %s\n", path);
         return NULL;
     }
 
-    Person *persons = xml_parse_persons(persons_node, settings);
-    Transaction *transactions = xml_parse_transactions(transactions_node, persons, settings); 
+    XmlLoadState state = {0};
+    state.person_index = person_index_alloc(0);
+    state.arena = create_arena();
+    int ret;
+    while ((ret = xmlTextReaderRead(reader)) == 1) {
+        if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT) {
+            continue;
+        }
+        if (xml_read_element(reader, &state)) {
+            ret = -1;
+            break;
+        }
+    }
+    xmlFreeTextReader(reader);
+    person_index_free(state.person_index);
+    free(state.persons_by_id);
 
-    Kitty *kitty = xml_parse_kitty(kitty_node, persons, settings, transactions);
-    if (!kitty) {
+    if (ret != 0 || !state.has_storage_info || !state.settings || !state.has_kitty || !state.has_persons || !state.has_transactions) {
+        fprintf(stderr, "Failed to parse %s\n", path);
+        arena_free(state.arena);
+        person_table_free(&state.person_table);
+        transaction_log_free(&state.transactions);
+        if (state.settings) {
+            currency_free(state.settings->currency);
+            settings_free(state.settings);
+        }
         return NULL;
     }
 
-    xmlFreeDoc(doc);
+    Kitty *kitty = create_kitty(state.balance, state.price, state.packs, state.counter,
+        state.settings, state.persons, &state.person_table, &state.transactions, state.arena);
+    kitty->generation = state.generation;
 
     return kitty;
 }
 
-/* saving functions */
+/* saving functions
+ *
+ * data.xml is streamed to a temporary file with a text writer, nothing but
+ * the writer's output buffer is held in memory. It replaces data.xml once it
+ * is complete.
+ */
 
-xmlNodePtr xml_create_currency_node(xmlNodePtr parent, const Currency *currency)
+int xml_write_start(xmlTextWriterPtr writer, const char *name)
 {
-    char buffer[20];
-    xmlNodePtr currency_node = xmlNewChild(parent, NULL, (const xmlChar*) "currency", NULL);
-    xmlNewProp(currency_node, (const xmlChar*) "isoname", (const xmlChar*) currency->isoname);
-    snprintf(buffer, sizeof(buffer), "%i", currency->prefix);
-    xmlNewProp(currency_node, (const xmlChar*) "prefix", (const xmlChar*) buffer);
-    snprintf(buffer, sizeof(buffer), "%i", currency->subunit_digits);
-    xmlNewProp(currency_node, (const xmlChar*) "subunit_digits", (const xmlChar*) buffer);
-    snprintf(buffer, sizeof(buffer), "%c", currency->decimal);
-    xmlNewProp(currency_node, (const xmlChar*) "decimal", (const xmlChar*) buffer);
-
-    return currency_node;
+    return xmlTextWriterStartElement(writer, (const xmlChar*) name) < 0;
 }
 
-xmlNodePtr xml_create_settings_node(xmlNodePtr parent, const Settings* settings)
+int xml_write_end(xmlTextWriterPtr writer)
 {
-    xmlNodePtr settings_node = xmlNewChild(parent, NULL, (const xmlChar*) "settings", NULL);
-    xml_create_currency_node(settings_node, settings->currency);
-
-    return settings_node;
+    return xmlTextWriterEndElement(writer) < 0;
 }
 
-xmlNodePtr xml_create_kitty_node(xmlNodePtr parent, const Kitty* kitty)
+int xml_write_attribute(xmlTextWriterPtr writer, const char *name, const char *value)
 {
-    xmlNodePtr kitty_node = xmlNewChild(parent, NULL, (const xmlChar*) "kitty", NULL);
-    char buffer[20];
-    snprintf(buffer, sizeof(buffer), "%i", kitty->balance->value);
-    xmlNewProp(kitty_node, (const xmlChar*) "balance", (const xmlChar*) buffer);
-    snprintf(buffer, sizeof(buffer), "%i", kitty->price->value);
-    xmlNewProp(kitty_node, (const xmlChar*) "price", (const xmlChar*) buffer);
-    snprintf(buffer, sizeof(buffer), "%i", kitty->packs);
-    xmlNewProp(kitty_node, (const xmlChar*) "packs", (const xmlChar*) buffer);
-    snprintf(buffer, sizeof(buffer), "%i", kitty->counter);
-    xmlNewProp(kitty_node, (const xmlChar*) "counter", (const xmlChar*) buffer);
-
-    return kitty_node;
+    return xmlTextWriterWriteAttribute(writer, (const xmlChar*) name, (const xmlChar*) value) < 0;
 }
 
-xmlNodePtr xml_create_person_node(xmlNodePtr parent, const Person* person)
+int xml_write_int_attribute(xmlTextWriterPtr writer, const char *name, long value)
 {
-    xmlNodePtr person_node = xmlNewChild(parent, NULL, (const xmlChar*) "person", NULL);
-    char buffer[20];
-    xmlNewProp(person_node, (const xmlChar*) "name", (const xmlChar*) person->name);
-    snprintf(buffer, sizeof(buffer), "%i", person->balance->value);
-    xmlNewProp(person_node, (const xmlChar*) "balance", (const xmlChar*) buffer);
-    snprintf(buffer, sizeof(buffer), "%f", person->thirst);
-    xmlNewProp(person_node, (const xmlChar*) "thirst", (const xmlChar*) buffer);
-    snprintf(buffer, sizeof(buffer), "%i", person->current_coffees);
-    xmlNewProp(person_node, (const xmlChar*) "current_coffees", (const xmlChar*) buffer);
-    snprintf(buffer, sizeof(buffer), "%i", person->total_coffees);
-    xmlNewProp(person_node, (const xmlChar*) "total_coffees", (const xmlChar*) buffer);
-
-    return person_node;
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%li", value);
+    return xml_write_attribute(writer, name, buffer);
 }
 
-xmlNodePtr xml_create_persons_node(xmlNodePtr parent, const Person* persons)
+int xml_write_currency(xmlTextWriterPtr writer, const Currency *currency)
 {
-    xmlNodePtr persons_node = xmlNewChild(parent, NULL, (const xmlChar*) "persons", NULL);
-    for (const Person *p = persons; p; p = p->next) {
-        xml_create_person_node(persons_node, p);
-    }
-    return persons_node;
+    char decimal[2] = {currency->decimal, '\0'};
+    int rc = xml_write_start(writer, "currency");
+    rc |= xml_write_attribute(writer, "isoname", currency->isoname);
+    rc |= xml_write_int_attribute(writer, "prefix", currency->prefix);
+    rc |= xml_write_int_attribute(writer, "subunit_digits", currency->subunit_digits);
+    rc |= xml_write_attribute(writer, "decimal", decimal);
+    rc |= xml_write_end(writer);
+
+    return rc;
 }
 
-xmlNodePtr xml_create_balance_delta_node(xmlNodePtr parent, const BalanceDelta* delta)
+int xml_write_storage_settings(xmlTextWriterPtr writer, const Settings* settings)
 {
-    xmlNodePtr delta_node = xmlNewChild(parent, NULL, (const xmlChar*) "balance_delta", NULL);
-    char buffer[20];
-    if (delta->target) {
-        xmlNewProp(delta_node, (const xmlChar*) "target", (const xmlChar*) delta->target->name);
-    } // else, target will be not set
-    snprintf(buffer, sizeof(buffer), "%i", delta->cv->value);
-    xmlNewProp(delta_node, (const xmlChar*) "value", (const xmlChar*) buffer);
+    int rc = xml_write_start(writer, "storage");
+    rc |= xml_write_int_attribute(writer, "journal", settings->journal);
+    rc |= xml_write_int_attribute(writer, "checkpoint_interval", settings->checkpoint_interval);
+    rc |= xml_write_int_attribute(writer, "indent", settings->indent);
+    rc |= xml_write_end(writer);
 
-    return delta_node;
+    return rc;
 }
 
-xmlNodePtr xml_create_balance_deltas_node(xmlNodePtr parent, const BalanceDelta* delta)
+int xml_write_settings(xmlTextWriterPtr writer, const Settings* settings)
 {
-    if (!delta) {
-        return NULL;
-    }
-    xmlNodePtr balance_deltas_node = xmlNewChild(parent, NULL, (const xmlChar*) "balance_deltas", NULL);
-    for(const BalanceDelta *b = delta; b; b = b->next) {
-        xml_create_balance_delta_node(balance_deltas_node, b);
-    }
+    int rc = xml_write_start(writer, "settings");
+    rc |= xml_write_currency(writer, settings->currency);
+    rc |= xml_write_storage_settings(writer, settings);
+    rc |= xml_write_end(writer);
 
-    return balance_deltas_node;
+    return rc;
 }
 
-xmlNodePtr xml_create_packs_delta_node(xmlNodePtr parent, const PacksDelta* delta)
+int xml_write_kitty(xmlTextWriterPtr writer, const Kitty* kitty)
 {
-    xmlNodePtr delta_node = xmlNewChild(parent, NULL, (const xmlChar*) "packs_delta", NULL);
-    char buffer[20];
-    snprintf(buffer, sizeof(buffer), "%i", delta->packs);
-    xmlNewProp(delta_node, (const xmlChar*) "value", (const xmlChar*) buffer);
-
-    return delta_node;
+    int rc = xml_write_start(writer, "kitty");
+    rc |= xml_write_int_attribute(writer, "balance", kitty->balance.value);
+    rc |= xml_write_int_attribute(writer, "price", kitty->price.value);
+    rc |= xml_write_int_attribute(writer, "packs", kitty->packs);
+    rc |= xml_write_int_attribute(writer, "counter", kitty->counter);
+    rc |= xml_write_end(writer);
+
+    return rc;
 }
 
-xmlNodePtr xml_create_packs_deltas_node(xmlNodePtr parent, const PacksDelta* delta)
+int xml_write_person(xmlTextWriterPtr writer, const PersonTable* table, const Person* person)
 {
-    if (!delta) {
-        return NULL;
-    }
-    xmlNodePtr packs_deltas_node = xmlNewChild(parent, NULL, (const xmlChar*) "packs_deltas", NULL);
-    for(const PacksDelta *p = delta; p; p = p->next) {
-        xml_create_packs_delta_node(packs_deltas_node, p);
+    char buffer[32];
+    int row = person->row;
+    int rc = xml_write_start(writer, "person");
+    rc |= xml_write_int_attribute(writer, "id", person->id);
+    rc |= xml_write_attribute(writer, "name", person->name);
+    rc |= xml_write_int_attribute(writer, "balance", table->balance[row].value);
+    snprintf(buffer, sizeof(buffer), "%f", table->thirst[row]);
+    rc |= xml_write_attribute(writer, "thirst", buffer);
+    rc |= xml_write_int_attribute(writer, "current_coffees", table->current_coffees[row]);
+    rc |= xml_write_int_attribute(writer, "total_coffees", table->total_coffees[row]);
+    if (table->removed[row]) {
+        rc |= xml_write_int_attribute(writer, "removed", 1);
     }
+    rc |= xml_write_end(writer);
 
-    return packs_deltas_node;
+    return rc;
 }
 
-xmlNodePtr xml_create_counter_delta_node(xmlNodePtr parent, const CounterDelta* delta)
+int xml_write_persons(xmlTextWriterPtr writer, const Kitty* kitty)
 {
-    xmlNodePtr delta_node = xmlNewChild(parent, NULL, (const xmlChar*) "counter_delta", NULL);
-    char buffer[20];
-    if (delta->target) {
-        xmlNewProp(delta_node, (const xmlChar*) "target", (const xmlChar*) delta->target->name);
-    } // else, target will be not set
-    snprintf(buffer, sizeof(buffer), "%i", delta->counter);
-    xmlNewProp(delta_node, (const xmlChar*) "value", (const xmlChar*) buffer);
+    int rc = xml_write_start(writer, "persons");
+    for (const Person *p = kitty->persons; p; p = p->next) {
+        rc |= xml_write_person(writer, &kitty->person_table, p);
+    }
+    rc |= xml_write_end(writer);
 
-    return delta_node;
+    return rc;
 }
 
-xmlNodePtr xml_create_counter_deltas_node(xmlNodePtr parent, const CounterDelta* delta)
+// writes the deltas of one kind, e.g. <balance_deltas><balance_delta .../>...</balance_deltas>
+int xml_write_deltas(xmlTextWriterPtr writer, const Transaction* transaction, enum delta_kind kind)
 {
-    if (!delta) {
-        return NULL;
+    static const char* const names[] = {
+        [BALANCE_DELTA] = "balance_delta",
+        [PACKS_DELTA] = "packs_delta",
+        [COUNTER_DELTA] = "counter_delta",
+    };
+    static const char* const group_names[] = {
+        [BALANCE_DELTA] = "balance_deltas",
+        [PACKS_DELTA] = "packs_deltas",
+        [COUNTER_DELTA] = "counter_deltas",
+    };
+
+    if (!transaction_has_deltas(transaction, kind)) {
+        return 0;
     }
-    xmlNodePtr counter_deltas_node = xmlNewChild(parent, NULL, (const xmlChar*) "counter_deltas", NULL);
-    for(const CounterDelta *c = delta; c; c = c->next) {
-        xml_create_counter_delta_node(counter_deltas_node, c);
+    int rc = xml_write_start(writer, group_names[kind]);
+    const Delta *deltas = transaction_deltas(transaction);
+    for (int i = 0; i < transaction->delta_count; i++) {
+        const Delta *d = &deltas[i];
+        if (d->kind != kind) {
+            continue;
+        }
+        rc |= xml_write_start(writer, names[kind]);
+        if (d->target) {
+            rc |= xml_write_int_attribute(writer, "target_id", d->target->id);
+        } // else, target will be not set
+        rc |= xml_write_int_attribute(writer, "value", d->value);
+        rc |= xml_write_end(writer);
     }
+    rc |= xml_write_end(writer);
 
-    return counter_deltas_node;
+    return rc;
 }
 
-xmlNodePtr xml_create_transaction_node(xmlNodePtr parent, const Transaction* transaction)
+int xml_write_transaction(xmlTextWriterPtr writer, const Transaction* transaction)
 {
-    xmlNodePtr transaction_node = xmlNewChild(parent, NULL, (const xmlChar*) "transaction", NULL);
-    char buffer[20];
-    snprintf(buffer, sizeof(buffer), "%i", transaction->type);
-    xmlNewProp(transaction_node, (const xmlChar*) "type", (const xmlChar*) buffer);
-    snprintf(buffer, sizeof(buffer), "%li", transaction->timestamp);
-    xmlNewProp(transaction_node, (const xmlChar*) "timestamp", (const xmlChar*) buffer);
-    xml_create_balance_deltas_node(transaction_node, transaction->balance_delta_head);
-    xml_create_packs_deltas_node(transaction_node, transaction->packs_delta_head);
-    xml_create_counter_deltas_node(transaction_node, transaction->counter_delta_head);
-
-    return transaction_node;
+    int rc = xml_write_start(writer, "transaction");
+    rc |= xml_write_int_attribute(writer, "type", transaction->type);
+    rc |= xml_write_int_attribute(writer, "timestamp", transaction->timestamp);
+    rc |= xml_write_deltas(writer, transaction, BALANCE_DELTA);
+    rc |= xml_write_deltas(writer, transaction, PACKS_DELTA);
+    rc |= xml_write_deltas(writer, transaction, COUNTER_DELTA);
+    rc |= xml_write_end(writer);
+
+    return rc;
 }
 
-xmlNodePtr xml_create_transactions_node(xmlNodePtr parent, const Transaction* transactions)
+int xml_write_transactions(xmlTextWriterPtr writer, const TransactionLog* transactions)
 {
-    xmlNodePtr transactions_node = xmlNewChild(parent, NULL, (const xmlChar*) "transactions", NULL);
-    for (const Transaction *t = transactions; t; t = t->next) {
-        xml_create_transaction_node(transactions_node, t);
+    int rc = xml_write_start(writer, "transactions");
+    for (size_t i = 0; i < transactions->length; i++) {
+        rc |= xml_write_transaction(writer, &transactions->items[i]);
     }
+    rc |= xml_write_end(writer);
 
-    return transactions_node;
+    return rc;
 }
 
 int save_kitty_to_xml(const char* path, const Kitty* kitty)
 {
-    xmlDocPtr doc = xmlNewDoc((const xmlChar*) "1.0");
-    if (!doc) {
-        fprintf(stderr, "Failed to create xml document\n");
+    char temp_path[PATH_MAX];
+    FILE *file = atomic_open(path, temp_path, sizeof(temp_path));
+    if (!file) {
+        fprintf(stderr, "Failed to create %s\n", temp_path);
         return 1;
     }
 
+    // the buffer flushes into the file, but leaves closing it to us
+    xmlOutputBufferPtr out = xmlOutputBufferCreateFile(file, NULL);
+    xmlTextWriterPtr writer = out ? xmlNewTextWriter(out) : NULL;
+    if (!writer) {
+        fprintf(stderr, "Failed to create xml writer\n");
+        if (out) {
+            xmlOutputBufferClose(out);
+        }
+        atomic_abort(file, temp_path);
+        return 1;
+    }
 
-    xmlNodePtr root = xmlNewNode(NULL, (const xmlChar*) "data");
-    xmlDocSetRootElement(doc, root);
+    if (kitty->settings->indent) {
+        xmlTextWriterSetIndent(writer, 1);
+        xmlTextWriterSetIndentString(writer, (const xmlChar*) "  ");
+    }
 
-    xmlNodePtr storage_info_node = xmlNewChild(root, NULL, (const xmlChar*) "storage_info", NULL);
-    xmlNewProp(storage_info_node, (const xmlChar*) "version", (const xmlChar*) KITTY_STORAGE_VERSION);
-    xml_create_settings_node(root, kitty->settings);
-    xml_create_kitty_node(root, kitty);
-    xml_create_persons_node(root, kitty->persons);
-    xml_create_transactions_node(root, kitty->transactions);
+    int rc = xmlTextWriterStartDocument(writer, "1.0", "UTF-8", NULL) < 0;
+    rc |= xml_write_start(writer, "data");
 
-    xmlSaveFormatFileEnc(path, doc, "UTF-8", 1);
-    xmlFreeDoc(doc);
+    rc |= xml_write_start(writer, "storage_info");
+    rc |= xml_write_attribute(writer, "version", KITTY_STORAGE_VERSION);
+    rc |= xml_write_int_attribute(writer, "generation", kitty->generation);
+    rc |= xml_write_end(writer);
 
-    return 0;
-}
\ No newline at end of file
+    rc |= xml_write_settings(writer, kitty->settings);
+    rc |= xml_write_kitty(writer, kitty);
+    rc |= xml_write_persons(writer, kitty);
+    rc |= xml_write_transactions(writer, &kitty->transactions);
+
+    rc |= xml_write_end(writer);
+    rc |= xmlTextWriterEndDocument(writer) < 0;
+    xmlFreeTextWriter(writer);
+
+    if (rc) {
+        atomic_abort(file, temp_path);
+    } else {
+        rc = atomic_commit(file, temp_path, path);
+    }
+    if (rc) {
+        fprintf(stderr, "Failed to write %s\n", path);
+    }
+    return rc;
+}
@@ -20,251 +20,223 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdbool.h>
 
 #include "person.h"
 #include "currency.h"
+#include "arena.h"
 
-BalanceDelta* balance_delta_alloc(CurrencyValue* cv, Person* target)
+void transaction_init(Transaction* t, enum transaction_type type, long timestamp)
 {
-    BalanceDelta* delta = malloc(sizeof(BalanceDelta));
-    delta->cv = cv;
-    delta->target = target;
-    delta->next = NULL;
-    return delta;
-}
-
-BalanceDelta* balance_delta_add(BalanceDelta** head, BalanceDelta* delta)
-{
-    BalanceDelta* end;
-    for (end = *head; end && end->next; end = end->next);
-
-    if (end == NULL) {
-        *head = delta;
-    } else {
-        end->next = delta;
-    }
+    t->type = type;
+    t->timestamp = timestamp;
+    t->delta_count = 0;
+    t->delta_capacity = TRANSACTION_INLINE_DELTAS;
 
-    return delta;
+    if (timestamp == -1)
+        t->timestamp = time(NULL);
 }
 
-void balance_delta_free(BalanceDelta* delta)
+// valid until the next delta is added
+Delta* transaction_deltas(const Transaction* t)
 {
-    currency_value_free(delta->cv);
-    free(delta);
+    if (t->delta_capacity > TRANSACTION_INLINE_DELTAS)
+        return t->overflow;
+    return (Delta*) t->inline_deltas;
 }
 
-void balance_deltas_free(BalanceDelta* head)
+void transaction_add_delta(Transaction* t, Arena* arena, enum delta_kind kind, int value, Person* target)
 {
-    BalanceDelta* bd = head;
-    while (bd) {
-        BalanceDelta* next = bd->next;
-        balance_delta_free(bd);
-        bd = next;
+    if (t->delta_count == t->delta_capacity) {
+        int capacity = 2 * t->delta_capacity;
+        Delta* deltas = arena_alloc(arena, capacity * sizeof(Delta));
+        memcpy(deltas, transaction_deltas(t), t->delta_count * sizeof(Delta));
+        t->overflow = deltas;
+        t->delta_capacity = capacity;
     }
+
+    transaction_deltas(t)[t->delta_count++] = (Delta) {kind, value, target};
 }
 
-PacksDelta* packs_delta_alloc(int packs)
+bool transaction_has_deltas(const Transaction* t, enum delta_kind kind)
 {
-    PacksDelta* delta = malloc(sizeof(PacksDelta));
-    delta->packs = packs;
-    delta->next = NULL;
-    return delta;
+    const Delta* deltas = transaction_deltas(t);
+    for (int i = 0; i < t->delta_count; i++) {
+        if (deltas[i].kind == kind)
+            return true;
+    }
+    return false;
 }
 
-PacksDelta* packs_delta_add(PacksDelta** head, PacksDelta* delta)
+void transaction_invert(const Transaction* transaction, Transaction* inverted, Arena* arena)
 {
-    PacksDelta* end;
-    for (end = *head; end && end->next; end = end->next);
+    transaction_init(inverted, UNDO, -1);
 
-    if (end == NULL) {
-        *head = delta;
-    } else {
-        end->next = delta;
+    const Delta* deltas = transaction_deltas(transaction);
+    for (int i = 0; i < transaction->delta_count; i++) {
+        transaction_add_delta(inverted, arena, deltas[i].kind, -deltas[i].value, deltas[i].target);
     }
-
-    return delta;
 }
 
-void packs_delta_free(PacksDelta* delta)
+/* log */
+
+void transaction_log_init(TransactionLog* log)
 {
-    free(delta);
+    log->items = NULL;
+    log->length = 0;
+    log->capacity = 0;
 }
 
-void packs_deltas_free(PacksDelta* head)
+void transaction_log_free(TransactionLog* log)
 {
-    PacksDelta* pd = head;
-    while (pd) {
-        PacksDelta* next = pd->next;
-        packs_delta_free(pd);
-        pd = next;
-    }
+    free(log->items);
+    transaction_log_init(log);
 }
 
-CounterDelta* counter_delta_alloc(int counter, Person* target)
+void transaction_log_reserve(TransactionLog* log, size_t capacity)
 {
-    CounterDelta* delta = malloc(sizeof(CounterDelta));
-    delta->counter = counter;
-    delta->target = target;
-    delta->next = NULL;
-    return delta;
+    if (capacity <= log->capacity)
+        return;
+
+    log->items = realloc(log->items, capacity * sizeof(Transaction));
+    log->capacity = capacity;
 }
 
-CounterDelta* counter_delta_add(CounterDelta** head, CounterDelta* delta)
+// the log takes over the deltas of t, pointers into it are valid until the next push
+Transaction* transaction_log_push(TransactionLog* log, const Transaction* t)
 {
-    CounterDelta* end;
-    for (end = *head; end && end->next; end = end->next);
-
-    if (end == NULL) {
-        *head = delta;
-    } else {
-        end->next = delta;
+    if (log->length == log->capacity) {
+        transaction_log_reserve(log, log->capacity ? 2 * log->capacity : 64);
     }
 
-    return delta;
+    log->items[log->length] = *t;
+    return &log->items[log->length++];
 }
 
-void counter_delta_free(CounterDelta* delta)
+Transaction* transaction_log_last(const TransactionLog* log)
 {
-    free(delta);
+    return log->length ? &log->items[log->length - 1] : NULL;
 }
 
-void counter_deltas_free(CounterDelta* head)
+// moves the last transaction to t, returns false if there is none
+bool transaction_log_pop(TransactionLog* log, Transaction* t)
 {
-    CounterDelta* cd = head;
-    while (cd) {
-        CounterDelta* next = cd->next;
-        counter_delta_free(cd);
-        cd = next;
-    }
+    if (!log->length)
+        return false;
+
+    *t = log->items[--log->length];
+    return true;
 }
 
-Transaction* transaction_alloc(enum transaction_type type, long timestamp)
-{
-    Transaction* t = malloc(sizeof(Transaction));
-    t->type = type;
-    t->timestamp = timestamp;
-    t->balance_delta_head = NULL;
-    t->counter_delta_head = NULL;
-    t->packs_delta_head = NULL;
-    t->next = NULL;
+/* time index */
 
-    if (timestamp == -1)
-        t->timestamp = time(NULL);
-
-    return t;
+void time_index_init(TimeIndex* index)
+{
+    index->items = NULL;
+    index->length = 0;
+    index->capacity = 0;
 }
 
-Transaction* transaction_add(Transaction** head, Transaction* transaction)
+void time_index_free(TimeIndex* index)
 {
-    Transaction* end;
-    for (end = *head; end && end->next; end = end->next);
-
-    if (end == NULL) {
-        *head = transaction;
-    } else {
-        end->next = transaction;
-    }
-
-    return transaction;
+    free(index->items);
+    time_index_init(index);
 }
 
-Transaction* transaction_pop(Transaction** head)
+static void time_index_reserve(TimeIndex* index, size_t capacity)
 {
-    if (!*head) // no transactions
-        return NULL;
+    if (capacity <= index->capacity)
+        return;
 
-    if (!(*head)->next) { // only one transaction
-        Transaction* t = *head;
-        *head = NULL;
-        return t;
-    }
-
-    Transaction *lt;
-    Transaction *oblt;
+    index->items = realloc(index->items, capacity * sizeof(size_t));
+    index->capacity = capacity;
+}
 
-    oblt = *head;
-    lt = oblt->next;
-    while (lt->next) { // while lt is not last (otherwise lt->next == NULL)
-        oblt = oblt->next;
-        lt = oblt->next;
-    }
+typedef struct TimedPosition {
+    long timestamp;
+    size_t position;
+} TimedPosition;
 
-    oblt->next = NULL;
-    return lt;
+static int compare_by_time(const void* a, const void* b)
+{
+    const TimedPosition* pa = a;
+    const TimedPosition* pb = b;
+    if (pa->timestamp != pb->timestamp)
+        return (pa->timestamp > pb->timestamp) - (pa->timestamp < pb->timestamp);
+    return (pa->position > pb->position) - (pa->position < pb->position);
 }
 
-Transaction* transaction_remove(Transaction** head, Transaction* transaction)
+void time_index_build(TimeIndex* index, const TransactionLog* log)
 {
-    if (!*head) // no transactions
-        return NULL;
+    time_index_reserve(index, log->length);
+    index->length = log->length;
 
-    if (*head == transaction) { // first transaction
-        Transaction* t = *head;
-        *head = (*head)->next;
-        return t;
+    // the log is in chronological order unless the clock was changed
+    bool sorted = true;
+    for (size_t i = 0; i < log->length; i++) {
+        index->items[i] = i;
+        if (i && log->items[i].timestamp < log->items[i - 1].timestamp)
+            sorted = false;
     }
 
-    // all other cases
-    Transaction* prev = *head;
-    while (prev->next && prev->next != transaction) { // shift until found and end is not reached
-        prev = prev->next;
+    if (!sorted) {
+        TimedPosition* timed = malloc(log->length * sizeof(TimedPosition));
+        for (size_t i = 0; i < log->length; i++) {
+            timed[i].timestamp = log->items[i].timestamp;
+            timed[i].position = i;
+        }
+        qsort(timed, log->length, sizeof(TimedPosition), compare_by_time);
+        for (size_t i = 0; i < log->length; i++)
+            index->items[i] = timed[i].position;
+        free(timed);
     }
-
-    if (prev->next == NULL) // transaction not found
-        return NULL;
-
-    Transaction* t = prev->next; // pick
-    prev->next = t->next; // reconnect
-    return t;
 }
 
-void transaction_free(Transaction* t)
+// position of the first transaction after timestamp, or at it unless inclusive
+static size_t time_index_bound(const TimeIndex* index, const TransactionLog* log, long timestamp, bool inclusive)
 {
-    balance_deltas_free(t->balance_delta_head);
-    counter_deltas_free(t->counter_delta_head);
-    packs_deltas_free(t->packs_delta_head);
-    free(t);
+    size_t low = 0;
+    size_t high = index->length;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        long t = log->items[index->items[middle]].timestamp;
+        if (t < timestamp || (inclusive && t == timestamp))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
 }
 
-void transactions_free(Transaction* head)
+// position of the first transaction at or after timestamp
+size_t time_index_lower_bound(const TimeIndex* index, const TransactionLog* log, long timestamp)
 {
-    Transaction* t = head;
-    while (t) {
-        Transaction* next = t->next;
-        transaction_free(t);
-        t = next;
-    }
+    return time_index_bound(index, log, timestamp, false);
 }
 
-Transaction* transaction_invert(Transaction* transaction)
+// adds the transaction at position of the log, which has to be its last
+void time_index_insert(TimeIndex* index, const TransactionLog* log, size_t position)
 {
-    Transaction* inverted = transaction_alloc(UNDO, -1);
+    if (index->length == index->capacity)
+        time_index_reserve(index, index->capacity ? 2 * index->capacity : 64);
 
-    for (BalanceDelta* bd = transaction->balance_delta_head; bd; bd = bd->next) {
-        CurrencyValue* cv = currency_value_new_negative(bd->cv);
-        balance_delta_add(&inverted->balance_delta_head, balance_delta_alloc(cv, bd->target));
-    }
-    for (PacksDelta* pd = transaction->packs_delta_head; pd; pd = pd->next) {
-        packs_delta_add(&inverted->packs_delta_head, packs_delta_alloc(-pd->packs));
-    }
-    for (CounterDelta* cd = transaction->counter_delta_head; cd; cd = cd->next) {
-        counter_delta_add(&inverted->counter_delta_head, counter_delta_alloc(-cd->counter, cd->target));
-    }
-
-    return inverted;
+    // the last position always comes last among equal timestamps
+    size_t at = time_index_bound(index, log, log->items[position].timestamp, true);
+    memmove(&index->items[at + 1], &index->items[at], (index->length - at) * sizeof(size_t));
+    index->items[at] = position;
+    index->length++;
 }
 
-Transaction* clear_transactions_with_target(Transaction** head, Person* target)
+// removes the transaction at position, the log still has to contain it
+void time_index_remove(TimeIndex* index, const TransactionLog* log, size_t position)
 {
-    for(Transaction* t = *head; t; t = t->next) {
-        if (
-            (t->balance_delta_head && t->balance_delta_head->target == target)
-            ||
-            (t->counter_delta_head && t->counter_delta_head->target == target)
-        ) {
-            transaction_remove(head, t);
-        }
-    }
+    size_t at = time_index_bound(index, log, log->items[position].timestamp, true);
+    while (at > 0 && index->items[at - 1] != position)
+        at--;
+    if (at == 0)
+        return;
 
-    return *head;
-}
\ No newline at end of file
+    at--;
+    memmove(&index->items[at], &index->items[at + 1], (index->length - at - 1) * sizeof(size_t));
+    index->length--;
+}